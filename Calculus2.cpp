@@ -29,7 +29,9 @@ void run()
 		cout << "> ";
 		getline(cin, s);
 		if(cin.fail() || s.empty())	break;
-		cout << "  " << *ns.eval(s.c_str()) << endl;
+		df_cache derivatives;
+		int_cache integrals;
+		cout << "  " << ns.simplify(ns.eval(s.c_str())) << endl;
 	}
 }
 
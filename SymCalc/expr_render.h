@@ -96,19 +96,16 @@ public:
 	{
 		const char header[] = "<math xmlns='http://www.w3.org/1998/Math/MathML'>", footer[] = "</math>";
 		expr_info me;
-		expr e = _parser.eval(src);
 		me.text = src;
-		me.source = e;
-		me.result = *e;
-
-		if(src.find('~') != string::npos)	me.result = ~me.result;
-
-		if(is<symbol>(me.result)) {
-			expr val = as<symbol>(me.result).value();
-			_parser.set(as<symbol>(me.result).name(), is<func>(val) ? val : me.result);
-			if(val != empty)	me.result = val;
+		{
+			df_cache derivatives;
+			int_cache integrals;
+			me.source = _parser.eval(src);
+			me.result = _parser.simplify(me.source, src.find('~') != string::npos);
 		}
 
+		if(is<symbol>(me.result) && as<symbol>(me.result).value() != empty)	me.result = as<symbol>(me.result).value();
+
 		auto mml_src = exp2mml(me.source);
 		auto mml_res = exp2mml(me.result);
 		me.mml = mml_src + (src.find('~') == string::npos ? "<mo mathcolor='red'>&rArr;</mo>" : "<mo>&asymp;</mo>") + mml_res;
@@ -1,12 +1,15 @@
 #include "stdafx.h"
 #include <codecvt>
 #include <complex>
+#include <sstream>
 #include "CppUnitTest.h"
 
 #pragma warning(disable:4503)
 
 #include "../calculus.h"
 #include "../parser.h"
+#include "../archive.h"
+#include "../modular.h"
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 using namespace cas;
@@ -91,6 +94,160 @@ namespace Tests
 			Assert::IsTrue(one < two);
 			Assert::IsFalse(two < one);
 		}
+		TEST_METHOD(BigIntegers)
+		{
+			symbol a{"a"}, b{"b"};
+			expr big = two ^ 40;
+			Assert::AreEqual("1099511627776", to_string(big).c_str());
+			Assert::AreEqual("-1099511627776", to_string(-big).c_str());
+			Assert::AreEqual("10000000000", to_string(make_num(100000) * 100000).c_str());
+			Assert::IsTrue(is<numeric, int_t>(big - big + 1));
+			Assert::IsTrue(is<numeric, int_t>((two ^ 31) - 1));
+			Assert::IsTrue(is<numeric, bigint>(big * big));
+			Assert::AreEqual(two ^ 80, big * big);
+			Assert::IsTrue(expr{1000} < big);
+			Assert::IsFalse(big < -big);
+			Assert::AreEqual(1099511627776.0, to_real(approx(big)));
+			Assert::IsTrue(to_string((a + b) ^ 40).find("137846528820") != std::string::npos);
+
+			bigint x = bigint{3}.pow(3000), y = bigint{7}.pow(2000), xy = x * y;
+			Assert::IsTrue(xy == y * x);
+			Assert::IsTrue(x * x == bigint{3}.pow(6000));
+			for(uint32_t p : {1000003u, 4294967291u}) {
+				auto rx = bigint{x}.div_small(p), ry = bigint{y}.div_small(p), rxy = bigint{xy}.div_small(p);
+				Assert::AreEqual((uint64_t)rx * ry % p, (uint64_t)rxy);
+			}
+
+			NScript ns;
+			Assert::AreEqual("12345678901234567890", to_string(*ns.eval("12345678901234567890")).c_str());
+			Assert::AreEqual(one, *ns.eval("12345678901234567890-12345678901234567889"));
+
+			detail::expr_writer w;
+			w.write(-big * big);
+			std::istringstream is(w.data());
+			Assert::AreEqual(-big * big, detail::expr_reader(is).read());
+		}
+		TEST_METHOD(BigRationals)
+		{
+			auto p = make_num(1, 2147483647), q = make_num(1, 2147483646);
+			Assert::AreEqual("4294967293/4611686011984936962", to_string(p + q).c_str());
+			Assert::IsTrue(is<numeric, bigrat>(p * q));
+			Assert::IsTrue(is<numeric, rational_t>(p + q - q));
+			Assert::AreEqual(one, (p * q) / (q * p));
+			Assert::IsTrue(p < q);
+			Assert::IsFalse(q < p);
+			Assert::IsTrue(q < p + q);
+			Assert::AreEqual("1099511627776/12157665459056928801", to_string(make_num(2, 3) ^ 40).c_str());
+			Assert::AreEqual(make_num(3, 2) ^ 40, make_num(2, 3) ^ -40);
+
+			expr h = zero, h30;								// harmonic numbers
+			for(int k = 1; k <= 1000; k++) {
+				h = h + make_num(1, k);
+				if(k == 30)	h30 = h;
+			}
+			Assert::AreEqual("9304682830147/2329089562800", to_string(h30).c_str());
+			std::function<expr(int, int)> pairwise = [&pairwise](int a, int b) { return a == b ? make_num(1, a) : pairwise(a, (a + b) / 2) + pairwise((a + b) / 2 + 1, b); };
+			Assert::AreEqual(h, pairwise(1, 1000));
+			Assert::AreEqual(7.485470860550345, to_real(approx(h)), 1e-12);
+		}
+		TEST_METHOD(Multiprecision)
+		{
+			Assert::IsTrue(sizeof(mpreal) <= sizeof(bigint) && sizeof(mpcomplex) <= sizeof(bigint) && sizeof(ball) <= sizeof(bigint));	// stored out of line
+			Assert::AreEqual("0.33333333333333333333333333333333333333333333333333", to_string(approx(make_num(1, 3), 50)).c_str());
+			Assert::AreEqual("1.4142135623730950488016887242096980785696718753769", to_string(approx(two ^ half, 50)).c_str());
+			Assert::AreEqual("3.141592653589793238462643383279502884197", to_string(approx(pi, 40)).c_str());
+			Assert::AreEqual("0.84147098480789650665250232163", to_string(approx(sin(one), 30)).c_str());
+			Assert::AreEqual("1.0000000000000000000000000000000000000001", to_string(approx(1 + (make_num(10) ^ -40), 41)).c_str());
+			Assert::AreEqual(1., to_real(approx(1 + (make_num(10) ^ -40))));
+			Assert::IsTrue(is<numeric, real_t>(approx(make_num(1, 3))));
+			Assert::AreEqual(two, approx(sin(pi / 6) * 4, 30));
+			Assert::AreEqual(20u, as<numeric, mpreal>(approx(make_num(1, 3), 20) + approx(make_num(1, 7), 40)).digits());
+			auto z = approx(sin(make_num(0.5, 1.)), 30);
+			Assert::AreEqual("0.739792264456013728316902780592+1.03133607425455128307409943463i", to_string(z).c_str());
+			Assert::AreEqual("1.4142135623730950488i", to_string(approx(power{make_num(-2), half}, 20)).c_str());
+			Assert::AreEqual(1., to_real(approx(approx(make_num(1, 3), 30) * 3)), 1e-15);
+
+			NScript ns;
+			ns.precision(25);
+			Assert::AreEqual("2.718281828459045235360287", to_string(*ns.eval("~e")).c_str());
+			ns.precision(0);
+			Assert::IsTrue(is<numeric, real_t>(*ns.eval("~e")));
+
+			detail::expr_writer w;
+			w.write(z), w.write(approx(pi, 60));
+			std::istringstream is(w.data());
+			detail::expr_reader r(is);
+			Assert::AreEqual(z, r.read());
+			Assert::AreEqual(approx(pi, 60), r.read());
+		}
+		TEST_METHOD(Intervals)
+		{
+			auto p = approx_interval(pi, 30);
+			Assert::IsTrue(as<numeric, ball>(p).accurate(30));
+			Assert::IsTrue(as<numeric, ball>(p).contains(boost::math::constants::pi<mpreal_t>()));
+			Assert::IsTrue(as<numeric, ball>(approx_interval(two ^ half, 40)).contains(sqrt(mpreal_t{2})));
+			Assert::IsTrue(as<numeric, ball>(approx_interval(e, 60)).digits() >= 60);
+
+			auto d = approx_interval(pi - make_num(355, 113), 20);		// 355/113 exceeds pi by 2.7e-7
+			Assert::IsTrue(as<numeric>(d).has_sign());
+			Assert::IsFalse(as<numeric>(-d).has_sign());
+			Assert::IsTrue(as<numeric, ball>(approx_interval(sin(make_num(bigint{10}.pow(22))), 15)).contains(mpreal_t{"-0.85220084976718880177270589375302936826176"}));
+			Assert::IsFalse(as<numeric, ball>(approx_interval(arcsin(two), 10)).accurate(1));
+			auto r = approx_interval((pi - 4) ^ half, 10);			// no real enclosure, the bounds are lost visibly
+			Assert::IsTrue(is<numeric, ball>(r) && !as<numeric, ball>(r).accurate(1));
+			Assert::IsTrue(isinf(as<numeric, ball>(r).rad()));
+		}
+		TEST_METHOD(Factorization)
+		{
+			auto f = detail::factorize(46337u * 46327u);
+			Assert::AreEqual(2, (int)f.size());
+			Assert::AreEqual(46327, (int)f[0].first);
+			Assert::AreEqual(46337, (int)f[1].first);
+			Assert::AreEqual(3, (int)detail::factorize(999999938u).size());
+			Assert::IsTrue(detail::is_prime(999999937u));
+			Assert::AreEqual(65535, (int)detail::iroot(4294967295u, 2));
+			Assert::AreEqual(40, (int)detail::iroot(65536u, 3));
+			Assert::AreEqual("9999999999", detail::iroot(bigint{10}.pow(40) - bigint{1}, 4).str().c_str());
+
+			Assert::AreEqual("999999937^1/2", to_string(make_num(999999937) ^ half).c_str());
+			Assert::AreEqual(7 * (make_num(20408162) ^ half), make_num(999999938) ^ half);
+			Assert::AreEqual(432 * (two ^ half), make_num(72) ^ make_num(3, 2));
+			Assert::AreEqual(18 * (make_num(432) ^ make_num(1, 6)), make_num(108) ^ make_num(5, 6));
+			Assert::AreEqual(make_num(1, 8), make_num(16) ^ make_num(-3, 4));
+			Assert::AreEqual(make_num(-2), make_num(-8) ^ make_num(1, 3));
+			Assert::AreEqual(make_num(bigint{3}.pow(20)), make_num(bigint{3}.pow(60)) ^ make_num(1, 3));
+		}
+		TEST_METHOD(Modular)
+		{
+			montgomery m{modular_prime(0)};
+			Assert::AreEqual(2147483647, (int)m.modulus());
+			Assert::IsTrue(modular_prime(1) < modular_prime(0) && detail::is_prime(modular_prime(2)));
+			modint a{m, 123456789}, b{m, -987654321};
+			Assert::AreEqual((int)(123456789ll * (2147483647 - 987654321) % 2147483647), (int)(a * b).value());
+			Assert::AreEqual(1, (int)(a * inverse(a)).value());
+			Assert::AreEqual(1, (int)pow(b, m.modulus() - 1).value());
+			Assert::IsTrue(a - a + b == b && -b + b == modint(m, 0));
+			montgomery m1{modular_prime(1)}, m2{modular_prime(1)};
+			Assert::IsTrue(modint(m, 5) != modint(m1, 5) && modint(m1, 5) == modint(m2, 5));
+			Assert::AreEqual(5, (int)(modint(m1, 2) + modint(m2, 3)).value());
+
+			std::vector<uint32_t> x{1, 2, 3}, y{4, 5, 6};
+			m.to(x), m.to(y), m.mul_add(x, y, m.to(10)), m.from(x);
+			Assert::AreEqual(63, (int)x[2]);
+
+			bigint n = -(bigint{10}.pow(30) + bigint{7});
+			std::vector<uint32_t> primes, residues, fraction;
+			for(size_t i = 0; i < 4; i++)	primes.push_back(modular_prime(i)), residues.push_back(residue(n, primes[i]));
+			Assert::AreEqual(n.str().c_str(), crt(residues, primes).str().c_str());
+			for(auto p : primes) {
+				montgomery mp{p};
+				fraction.push_back((modint(mp, -22) * inverse(modint(mp, 7))).value());
+			}
+			bigrat r;
+			Assert::IsTrue(rational_reconstruction(crt(fraction, primes), bigint{primes[0]} * bigint{primes[1]} * bigint{primes[2]} * bigint{primes[3]}, r));
+			Assert::AreEqual("-22/7", r.str().c_str());
+			Assert::IsFalse(rational_reconstruction(bigint{200000014}, bigint{primes[0]}, r));
+		}
 		TEST_METHOD(Rationals)
 		{
 			numeric half{rational_t{ 1, 2 }}, minus_two_third{rational_t{-2, 3}};
@@ -162,6 +319,21 @@ namespace Tests
 			Assert::IsTrue(i < c3p2i && 0.5 < c3p2i);
 			Assert::IsFalse(c3p2i < c1mi);
 		}
+		TEST_METHOD(GaussianRationals)
+		{
+			Assert::IsTrue(sizeof(gaussian) <= sizeof(bigint));		// stored out of line
+			NScript ns;
+			Assert::IsTrue(is<numeric, gaussian>(*ns.eval("i")));
+			Assert::AreEqual(minus_one, *ns.eval("i^2"));
+			Assert::AreEqual("-i", to_string(*ns.eval("i^-1")).c_str());
+			Assert::AreEqual("41-38i", to_string(*ns.eval("(1+2*i)^5")).c_str());
+			Assert::AreEqual("1/2-1/2i", to_string(*ns.eval("1/(1+i)")).c_str());
+			Assert::AreEqual(make_num(13), *ns.eval("(3+2*i)*(3-2*i)"));
+			Assert::AreEqual("2i", to_string(*ns.eval("(-4)^(1/2)")).c_str());
+			Assert::AreEqual("1+12345678901234567890i", to_string(*ns.eval("12345678901234567890*i+1")).c_str());
+			Assert::AreEqual("1.5+1.5i", to_string(*ns.eval("1.5*(1+i)")).c_str());
+			Assert::IsTrue(is<numeric, complex_t>(*ns.eval("~(1+i)")));
+		}
 		TEST_METHOD(Symbolic)
 		{
 			symbol x{"x"}, y{"y"}, a{"a"}, b{"b"};
@@ -193,6 +365,37 @@ namespace Tests
 			Assert::AreEqual("y^2", to_string((x*y) | (x = expr{y})).c_str());
 			Assert::AreEqual("11", to_string(((x ^ 2) + 2 * x + 3) | (x = 2)).c_str());
 		}
+		TEST_METHOD(Polynomials)
+		{
+			symbol x{"x"}, y{"y"}, z{"z"};
+			expr a = (x^2) + 2*x*y + 1, b = x - y + sin(x);
+			list_t vars = polynomial::variables(a + b);
+			Assert::AreEqual(3, (int)vars.size());
+			polynomial p{vars}, q{vars};
+			Assert::IsTrue(polynomial::from_expr(a, vars, p) && polynomial::from_expr(b, vars, q));
+			Assert::AreEqual(a, p.to_expr());
+			Assert::AreEqual(3, (int)p.terms().size());
+			Assert::AreEqual(2, (int)p.exponent(p.terms()[0].first, 0));
+			Assert::AreEqual(a + b, (p + q).to_expr());
+			Assert::AreEqual(a * b, (p * q).to_expr());
+			Assert::AreEqual(a * a * a, pow(p, 3).to_expr());
+			Assert::IsTrue((p + p * polynomial{vars, {{0, numeric_t{-1}}}}).empty());
+			Assert::IsFalse(polynomial::from_expr(x ^ half, vars, p));
+			Assert::IsFalse(polynomial::from_expr(z, vars, p));
+			polynomial big{{x, y, z}, {{polynomial::monomial_t{1} << 42, numeric_t{1}}}};
+			Assert::AreEqual((int)big.max_exponent(), (int)big.exponent(pow(big, (unsigned)big.max_exponent()).terms()[0].first, 0));
+			bool overflow = false;
+			try { pow(big, (unsigned)big.max_exponent() + 1); } catch(error_t e) { overflow = e == error_t::limit; }
+			Assert::IsTrue(overflow);
+
+			expr s = x + y + z + 1;
+			Assert::AreEqual(1771, (int)as<sum>(s ^ 20).items().size());
+			Assert::AreEqual(s ^ 5, (s ^ 2) * (s ^ 3));
+			Assert::AreEqual("x^3+3x^2sin(x)+3xsin(x)^2+sin(x)^3", to_string((x + sin(x)) ^ 3).c_str());
+			Assert::AreEqual(make_num(bigint{2}.pow(40)), ((x + 1) ^ 40) | (x = 1));
+			expr xn = x ^ 1073741824;								// x²³¹ does not fit the exponents of a polynomial
+			Assert::AreEqual((x ^ make_num(bigint{2}.pow(31))) + 2 * xn + 1, (xn + 1) ^ 2);
+		}
 		TEST_METHOD(Functions)
 		{
 			symbol x{"x"}, y{"y"};
@@ -214,6 +417,17 @@ namespace Tests
 			// User
 			func f{"f", xset{x,y}, y / x};
 			Assert::AreEqual(one / 5, f(5, 1));
+			// Descriptors
+			Assert::IsTrue(as<func>(sin(x)).impl() == as<func>(sin(x * y)).impl());
+			Assert::IsTrue(func{"g", x}.impl() == func{"h", y}.impl());
+			auto sine = as<func>(sin(x)).impl();
+			Assert::IsTrue(func::find(S_SIN) == sine && func{S_SIN, y}.impl() == sine);
+			NScript ns, other;										// user definitions stay in the script that made them
+			ns.simplify(ns.eval("sq(x)=x^2"));
+			Assert::AreEqual(expr{9}, ns.simplify(ns.eval("sq(3)")));
+			Assert::IsTrue(func::find("sq") == nullptr && func{"sq", y}.impl() == func{"g", x}.impl());
+			Assert::AreEqual(expr{func{"sq", expr{3}}}, other.simplify(other.eval("sq(3)")));
+			Assert::AreEqual(cos(x * y) * y, df(sin(x * y), x));
 		}
 		TEST_METHOD(Approximation)
 		{
@@ -319,6 +533,263 @@ namespace Tests
 			Assert::AreEqual(eargs, fint(xset{3}));
 			Assert::AreEqual(eargs, fint(xset{3, 4, 5, 6, 7}));
 		}
+		TEST_METHOD(Sharing)
+		{
+			symbol x{"x"}, y{"y"}, a{"a", 2};
+			auto e1 = (x + 1)*(y ^ 2), e2 = (x + 1)*(y ^ 2);
+			Assert::IsTrue(detail::identical(e1, e2));
+			Assert::IsTrue(std::hash<expr>()(e1) == std::hash<expr>()(e2));
+			Assert::IsTrue(std::hash<expr>()(x) == std::hash<expr>()(symbol{"x", 5}));
+			std::unordered_set<expr> terms{e1, x, y, x + 1};
+			Assert::AreEqual(1, (int)terms.count(e2));
+			Assert::AreEqual(0, (int)terms.count(x * y));
+			Assert::IsFalse(e1 == (x + 2)*(y ^ 2));
+			Assert::IsTrue(power{a, 2} == power{symbol{"a"}, 2});
+			Assert::IsFalse(detail::identical(power{a, 2}, power{symbol{"a"}, 2}));
+			bool mode = set_interning(false);
+			auto e3 = (x + 1)*(y ^ 2);
+			set_interning(mode);
+			Assert::IsFalse(detail::identical(e1, e3));
+			Assert::AreEqual(e1, e3);
+			Assert::AreEqual(e1 ^ 2, e3 ^ 2);
+			Assert::IsFalse(power{e3, x}.node().exact());
+			Assert::IsTrue(as<product>(2 * sin(x) * pi).node().exact());	// functions and constants keep the fast path
+			Assert::IsFalse(func{"f", x} == func{"f", x, x});			// functions are identified by name and descriptor
+		}
+		TEST_METHOD(Arena)
+		{
+			symbol x{"x"}, y{"y"};
+			expr e;
+			{
+				eval_arena arena;
+				e = (x + 1) ^ (x * y);
+				Assert::IsTrue(arena.bytes() > 0);
+				Assert::IsTrue(as<power>(e).node().pool != nullptr);
+				Assert::IsTrue(as<power>(e).node().exact());		// arena nodes over heap symbols keep the fast path
+			}
+			auto p = promote(e);
+			Assert::IsTrue(as<power>(p).node().pool == nullptr);
+			Assert::IsTrue(as<power>(p).node().exact());
+			Assert::AreEqual(e, p);
+			Assert::AreEqual(expr{power{e, y}}, expr{power{p, y}});		// parent over the arena original is not exact
+			Assert::IsFalse(power{e, y}.node().exact());
+			Assert::AreEqual(e ^ 2, p ^ 2);
+			{
+				eval_arena arena;
+				Assert::IsTrue(power{p, y}.node().exact());				// heap copies are exact children in later arenas
+				Assert::IsFalse(power{e, y}.node().exact());			// but nodes of other arenas are not
+			}
+			NScript ns;
+			Assert::AreEqual((x + 1) ^ 2, *ns.eval("x^2+2*x+1"));
+			auto parsed = ns.eval("x^2+2*x+1");
+			auto bytes = ns.allocated();
+			auto r = ns.simplify(parsed);
+			Assert::AreEqual((x + 1) ^ 2, r);
+			Assert::IsTrue(as<power>(r).node().pool == nullptr);
+			Assert::IsTrue(ns.allocated() > bytes);					// bytes of the simplification are counted too
+		}
+
+		TEST_METHOD(Terms)
+		{
+			symbol x{"x"}, y{"y"}, z{"z"};
+			expr s = x + y + z + 1;
+			Assert::IsTrue(is<sum>(s));
+			Assert::AreEqual(size_t(4), as<sum>(s).size());
+			Assert::IsTrue(std::is_sorted(as<sum>(s).begin(), as<sum>(s).end(), sum::key_comp()));
+			Assert::AreEqual(expr{y + z + 1}, s - x);
+			Assert::AreEqual(expr{y + z + 1}, s | (x = 0));
+			expr p = x * y * z * 2;
+			Assert::IsTrue(is<product>(p));
+			Assert::AreEqual(size_t(4), as<product>(p).size());
+			Assert::AreEqual(x * z * 2, p / y);
+			Assert::AreEqual(y * z * 2 + x * z * 2 + x * y * 2, df(p, x) + df(p, y) + df(p, z));
+			list_t factors;
+			for(int i = 1; i <= 30; i++)	factors.push_back(sin(x + i));
+			Assert::AreEqual(size_t(30), as<sum>(df(make_prod(factors), x)).size());	// one term per factor
+			Assert::AreEqual(((x + y + z) ^ 2) * (x + y + z), (x + y + z) ^ 3);
+			Assert::AreEqual(make_sum({x, y, 2 * x, -y, 3}), 3 * x + 3);
+			Assert::AreEqual(make_prod({x, y, x ^ 2, y ^ -1, 3, z}), 3 * (x ^ 3) * z);
+			Assert::AreEqual(make_sum({2 * x * sin(y), x * sin(z), sin(x), x * sin(x), 4 * x * sin(y)}), 6 * x * sin(y) + x * sin(z) + sin(x) + x * sin(x));
+			Assert::AreEqual(1 + 2 * sin(x) * cos(x), (sin(x) + cos(x)) ^ 2);
+			list_t trig{sin(x) ^ 2, cos(x) ^ 2};
+			for(int i = 1; i <= 30; i++)	trig.push_back(sin(x + i) ^ 2), trig.push_back(cos(y + i));
+			Assert::AreEqual(size_t(61), as<sum>(make_sum(trig)).size());	// only sin²x and cos²x are paired
+			Assert::AreEqual(tg(x) * sin(y), make_prod({cos(x) ^ -1, sin(y), sin(x)}));
+			Assert::AreEqual(ln(x) * ln(y), ln(y) * ln(x));
+			Assert::AreEqual("z+sin(x)+sin(y)", to_string(sin(y) + z + sin(x)).c_str());
+			expr t = 0;												// like terms are found through the key index of the list
+			for(int i = 1; i <= 200; i++)	t = t + i * (x ^ (i % 100)) * y;
+			list_t expected{300 * y};
+			for(int k = 1; k < 100; k++)	expected.push_back((2 * k + 100) * (x ^ k) * y);
+			Assert::AreEqual(size_t(100), as<sum>(t).size());
+			Assert::AreEqual(make_sum(expected), t);
+			Assert::AreEqual(one, (sin(x) ^ 2) + y + (cos(x) ^ 2) - y);
+			Assert::IsTrue(detail::degree_of(x * (y ^ 2)) > detail::degree_of(x * y) && detail::degree_of(x * y) > detail::degree_of(y ^ 5));
+			Assert::IsTrue(sum_comp()(x ^ 120, x ^ 110) && !sum_comp()(x ^ 110, x ^ 120));	// degrees are not capped at 99
+			Assert::IsTrue(prod_comp()(y, x ^ 2) && prod_comp()(sin(x), sin(y)));
+		}
+
+		TEST_METHOD(Symbols)
+		{
+			symbol x{"x"}, y{"y"}, x2{"x", 2};
+			Assert::AreEqual(x.sid(), x2.sid());
+			Assert::IsTrue(x.sid() != y.sid());
+			Assert::AreEqual(x, x2);
+			Assert::IsTrue(x < y);
+			Assert::AreEqual("x", x2.name().c_str());
+			Assert::IsTrue(as<symbol>(pi).sid() == detail::symbol_table::const_pi);
+			Assert::AreEqual(two, x2 | x2);
+			NScript ns;
+			Assert::AreEqual(expr{x}, *ns.eval("x"));
+			// Free symbols
+			symbol z{"z", x + 1};
+			Assert::IsTrue(depends_on(sin(x) * (y ^ 2), x));
+			Assert::IsFalse(depends_on(sin(y) + (y ^ 2), x));
+			Assert::IsTrue(depends_on(z * y, x));
+			Assert::IsTrue(depends_on(func{"f", y, x * y}, x));
+			for(int i = 0; i < 100; i++)	Assert::IsFalse(depends_on(symbol{"s" + std::to_string(i)} * y, x));
+			Assert::IsTrue(depends_on(symbol{"s99"} * y, symbol{"s99"}));
+		}
+
+		TEST_METHOD(Substitution)
+		{
+			symbol x{"x"}, y{"y"}, z{"z"};
+			list_t terms;
+			for(int i = 1; i <= 200; i++)	terms.push_back(i * (y ^ i) * sin(z));
+			expr s = make_sum(terms);
+			Assert::IsTrue(detail::identical(s | (x = 1), s));
+			expr l = ln(s);
+			expr g = (l + x) | (x = 2);
+			auto& items = as<sum>(g).items();
+			Assert::IsTrue(std::any_of(items.begin(), items.end(), [&l](const expr& e) { return detail::identical(e, l); }));
+			Assert::AreEqual(6 + sin(z), subst(x * y + sin(z), list_t{x = 2, y = 3}));
+			Assert::AreEqual(z + sin(y), subst(x + sin(x + y), xset{x + y, x}, xset{y, z}));
+		}
+
+		TEST_METHOD(Traversal)
+		{
+			symbol x{"x"}, y{"y"};
+			expr a = x;
+			for(int i = 0; i < 40; i++)	a = sin(a) + cos(a);		// 2⁴⁰ paths through 80 distinct nodes
+			Assert::AreEqual(a, simplify(a));
+			Assert::IsTrue(detail::identical(promote(a), a));
+			Assert::IsTrue(detail::identical(a | (y = 1), a));
+			Assert::IsTrue(is<numeric>(approx(a | (x = 1))));
+		}
+
+		TEST_METHOD(Budget)
+		{
+			NScript ns;
+			expr f = ns.eval("dif(dif(dif(dif(dif(sin(x)^x,x),x),x),x),x)");
+			expr full = *f;
+			auto aborted = [&f](const eval_limits& limits) {
+				eval_budget budget(limits);
+				try {
+					*f;
+				} catch(error_t e) {
+					return e == error_t::limit;
+				}
+				return false;
+			};
+			eval_limits limits;
+			Assert::IsFalse(aborted(limits));
+			limits.nodes = 1000;
+			Assert::IsTrue(aborted(limits));
+			limits.nodes = SIZE_MAX, limits.depth = 5;
+			Assert::IsTrue(aborted(limits));
+			limits.depth = SIZE_MAX, limits.time = std::chrono::milliseconds(0);
+			Assert::IsTrue(aborted(limits));
+			Assert::AreEqual(full, *f);
+
+			limits.time = std::chrono::milliseconds::max(), limits.nodes = 5;
+			ns.limit(limits);
+			Assert::AreEqual(make_err(error_t::limit), ns.eval("a+b+c+d+e+f+g"));
+			ns.limit(eval_limits{});
+			Assert::IsTrue(is<sum>(ns.eval("a+b+c+d+e+f+g")));
+			limits.nodes = 1000;
+			ns.limit(limits);
+			Assert::AreEqual(make_err(error_t::limit), ns.simplify(f));	// simplification has the budget of the script
+			ns.limit(eval_limits{});
+			Assert::AreEqual(full, ns.simplify(f));
+		}
+
+		TEST_METHOD(Memo)
+		{
+			symbol x{"x"}, y{"y"};
+			expr f = sin(x * y) * (x ^ 3) + ln(x + y);
+			df_cache memo;
+			expr d2 = df(df(f, x), x);
+			Assert::IsTrue(memo.misses() > 0);
+			auto hits = memo.hits();
+			Assert::AreEqual(d2, df(df(f, x), x));
+			Assert::IsTrue(memo.hits() > hits);
+			{
+				df_cache small(2);
+				Assert::AreEqual(d2, df(df(f, x), x));
+				Assert::IsTrue(small.size() <= 2);
+			}
+		}
+
+		TEST_METHOD(IntegralMemo)
+		{
+			symbol x{"x"}, y{"y"}, c{"c"};
+			expr f = (x ^ 3) * (e ^ (2 * x)) + x * ln(x) * sin(y) + (e ^ (x ^ 2));
+			expr F;
+			struct temp_file {
+				string path = std::tmpnam(nullptr);					// unique name in the temporary directory
+				~temp_file() { std::remove(path.c_str()); }			// removed even if an assertion fails
+			} file;
+			const string& path = file.path;
+			{
+				int_cache memo;
+				F = intf(f, x);
+				auto hits = memo.hits();
+				Assert::AreEqual(F, intf(f, x));
+				Assert::AreEqual(F + c, intf(f, x, c));
+				Assert::IsTrue(memo.hits() > hits);
+				auto user = func{"g", x, x ^ 2};
+				intf(user * x, x);
+				Assert::IsTrue(save(memo, path) > 0);
+				Assert::IsTrue(save(memo, path) < memo.size());		// user-defined bodies are not stored
+				detail::expr_writer w;
+				w.write(func{S_SIN, x, x ^ 2});
+				Assert::IsFalse(w.ok());
+			}
+			int_cache memo;
+			Assert::IsTrue(load(memo, path) > 0);
+			Assert::AreEqual(F, intf(f, x));
+			Assert::AreEqual(size_t(0), memo.misses());
+			std::ofstream(path, std::ios::binary | std::ios::app) << "garbage";
+			int_cache other;
+			Assert::AreEqual(memo.size(), load(other, path));
+			std::remove(path.c_str());
+			Assert::AreEqual(size_t(0), load(other, path));
+		}
+
+		// Nodes and arena bytes created by df of Σ i∙xⁱ∙y with n terms
+		static std::pair<size_t, size_t> df_cost(int n)
+		{
+			symbol x{"x"}, y{"y"};
+			list_t terms;
+			for(int i = 1; i <= n; i++)	terms.push_back(i * (x ^ i) * y);
+			expr s = make_sum(terms);
+			eval_arena arena;
+			eval_budget budget{eval_limits{}};
+			expr d = df(s, x);
+			Assert::AreEqual(size_t(n), as<sum>(d).size());
+			return {budget.nodes(), arena.bytes()};
+		}
+		TEST_METHOD(LargeDerivative)
+		{
+			auto small = df_cost(1250), large = df_cost(2500);
+			std::stringstream ss;
+			ss << "df of 2500 terms: " << large.first << " nodes, " << large.second << " arena bytes\n";
+			Logger::WriteMessage(ss.str().c_str());
+			// doubling the terms doubles the cost, any per-term work that grows with the size of the sum shows up here
+			Assert::IsTrue(large.first * 20 <= small.first * 41);
+			Assert::IsTrue(large.second * 20 <= small.second * 41);
+			Assert::IsTrue(large.first > 2500);
+		}
 
 	};
 }
\ No newline at end of file
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <cstring>
+#include <fstream>
+#include "calculus.h"
+
+namespace cas {
+namespace detail {
+
+// Compact binary form of expressions: a node is its type index followed by its contents, children in pre-order.
+// Integers are little-endian, symbols and functions are stored by name, so files do not depend on symbol ids.
+// Multiprecision numbers and balls are stored as their precision and decimal strings of all computed digits.
+// Functions are restored through their builtin factories or as undefined functions. Nodes of other descriptors
+// (user-defined bodies, which are not registered anywhere) cannot be restored, the writer rejects them.
+class expr_writer
+{
+	string	_buf;
+	bool	_ok = true;
+
+	void name(const string& s) { u32((uint32_t)s.size()); _buf += s; }
+	void items(const list_t& items) { u32((uint32_t)items.size()); for(auto& e : items)	write(e); }
+	void real(real_t v) { uint64_t bits; std::memcpy(&bits, &v, sizeof bits); u64(bits); }
+	void num(int_t v)				{ byte(0); u32((uint32_t)v); }
+	void num(const rational_t& v)	{ byte(1); u32((uint32_t)v.numer()); u32((uint32_t)v.denom()); }
+	void num(real_t v)				{ byte(2); real(v); }
+	void num(const complex_t& v)	{ byte(3); real(v.real()); real(v.imag()); }
+	void num(const bigint& v)		{ byte(4); big(v); }
+	void num(const bigrat& v)		{ byte(5); big(v.numer()); big(v.denom()); }
+	void num(const gaussian& v)		{ byte(9); big(v.re().numer()); big(v.re().denom()); big(v.im().numer()); big(v.im().denom()); }
+	void num(const mpreal& v)		{ byte(6); u32(v.digits()); name(v.value().str(0, std::ios_base::scientific)); }
+	void num(const mpcomplex& v)	{ byte(7); u32(v.digits()); name(v.value().real().str(0, std::ios_base::scientific)); name(v.value().imag().str(0, std::ios_base::scientific)); }
+	void num(const ball& v)			{ byte(8); u32(v.digits()); name(v.mid().str(0, std::ios_base::scientific)); name(v.rad().str(0, std::ios_base::scientific)); }
+	void big(const bigint& v)		{ byte(v.negative()); u32((uint32_t)v.limbs().size()); for(auto l : v.limbs())	u32(l); }
+
+public:
+	static expr make_func(const string& name, const expr& x);
+
+	const string& data() const { return _buf; }
+	bool ok() const { return _ok; }			// false if some function cannot be restored by name
+	// FNV-1a of the written bytes: structural hash of the written expressions that does not depend on the process
+	uint64_t checksum() const { uint64_t h = 14695981039346656037ull; for(auto c : _buf)	h = (h ^ (uint8_t)c) * 1099511628211ull; return h; }
+
+	void byte(uint8_t b)	{ _buf.push_back((char)b); }
+	void u32(uint32_t v)	{ for(int i = 0; i < 4; i++)	byte((uint8_t)(v >> 8 * i)); }
+	void u64(uint64_t v)	{ for(int i = 0; i < 8; i++)	byte((uint8_t)(v >> 8 * i)); }
+
+	void write(const expr& e) {
+		byte((uint8_t)e.which());
+		if(is<error>(e))			byte((uint8_t)as<error>(e).get());
+		else if(is<numeric>(e))		boost::apply_visitor([this](const auto& v) { num(v); }, as<numeric>(e).value());
+		else if(is<symbol>(e))		name(as<symbol>(e).name()), write(as<symbol>(e).value());
+		else if(is<power>(e))		write(as<power>(e).x()), write(as<power>(e).y());
+		else if(is<product>(e))		items(as<product>(e).items());
+		else if(is<sum>(e))			items(as<sum>(e).items());
+		else if(is<xset>(e))		items(as<xset>(e).items());
+		else if(is<func>(e)) {
+			auto& f = as<func>(e);
+			auto g = make_func(f.name(), f.x());
+			if(!is<func>(g) || as<func>(g).impl() != f.impl())	_ok = false;
+			name(f.name()), write(f.x());
+		}
+	}
+};
+
+// Reads expressions written by expr_writer, throws error_t::syntax on truncated or malformed input
+class expr_reader
+{
+	std::istream&	_is;
+
+	string name()	{ string s; for(auto n = u32(); n; n--)	s.push_back((char)byte()); return s; }
+	list_t items()	{ list_t items; for(auto n = u32(); n; n--)	items.push_back(read()); return items; }
+	real_t real()	{ uint64_t bits = u64(); real_t v; std::memcpy(&v, &bits, sizeof v); return v; }
+	bigint big()	{ bool neg = byte() != 0; std::vector<uint32_t> limbs; for(auto n = u32(); n; n--)	limbs.push_back(u32()); return bigint{std::move(limbs), neg}; }
+	mpreal_t mp()	{ try { return mpreal_t{name()}; } catch(std::runtime_error&) { throw error_t::syntax; } }
+	numeric value() {
+		switch(byte()) {
+		case 0:		return (int_t)u32();
+		case 1:		{ auto n = (int_t)u32(); return numeric{n, (int_t)u32()}; }
+		case 2:		return real();
+		case 3:		{ auto re = real(); return complex_t{re, real()}; }
+		case 4:		return big();
+		case 5:		{ auto n = big(); return bigrat{n, big()}; }
+		case 6:		{ auto digits = u32(); return mpreal{mp(), digits}; }
+		case 7:		{ auto digits = u32(); auto re = mp(); return mpcomplex{{re, mp()}, digits}; }
+		case 8:		{ auto digits = u32(); auto mid = mp(); return ball{mid, mp(), digits}; }
+		case 9:		{ auto n = big(); auto re = bigrat{n, big()}; n = big(); return gaussian{re, bigrat{n, big()}}; }
+		default:	throw error_t::syntax;
+		}
+	}
+
+public:
+	explicit expr_reader(std::istream& is) : _is(is) {}
+
+	uint8_t byte()	{ char c; if(!_is.get(c))	throw error_t::syntax; return (uint8_t)c; }
+	uint32_t u32()	{ uint32_t v = 0; for(int i = 0; i < 4; i++)	v |= (uint32_t)byte() << 8 * i; return v; }
+	uint64_t u64()	{ uint64_t v = 0; for(int i = 0; i < 8; i++)	v |= (uint64_t)byte() << 8 * i; return v; }
+
+	expr read() {
+		switch(byte()) {
+		case 0:		{ auto err = byte(); if(err > (uint8_t)error_t::limit)	throw error_t::syntax; return error{(error_t)err}; }
+		case 1:		return value();
+		case 2:		{ auto s = name(); return symbol{s, read()}; }
+		case 3:		{ auto s = name(); return expr_writer::make_func(s, read()); }
+		case 4:		{ auto x = read(); return power{x, read()}; }
+		case 5:		return product(items());
+		case 6:		return sum(items());
+		case 7:		return xset(items());
+		default:	throw error_t::syntax;
+		}
+	}
+};
+
+inline expr expr_writer::make_func(const string& name, const expr& x) {
+	static const std::unordered_map<string, expr(*)(expr)> builtins = {
+		{S_LN, ln}, {S_SIN, sin}, {S_COS, cos}, {S_TG, tg}, {S_ASIN, arcsin}, {S_ACOS, arccos}, {S_ATG, arctg}
+	};
+	auto it = builtins.find(name);
+	if(it != builtins.end())	return it->second(x);
+	auto args = is<xset>(x) ? as<xset>(x).items() : list_t{};
+	if(name == S_DIF && args.size() == 2)		return make_dif(args[0], args[1]);
+	if(name == S_INT && args.size() == 2)		return make_int(args[0], args[1]);
+	if(name == S_INT && args.size() == 4)		return make_intd(args[0], args[1], args[2], args[3]);
+	if(name == S_ASSIGN && args.size() == 2)	return make_assign(args[0], args[1]);
+	if(name == S_SUBST && args.size() == 2)		return make_subst(args[0], args[1]);
+	return func{name, x, undefined_fun()};
+}
+
+const char memo_magic[] = "CMEM";
+const uint32_t memo_version = 1;
+
+}
+
+// Saves the memo to a binary file: signature, version, number of entries, then (expression, variable, result)
+// triples followed by their structural hash. Entries with functions that cannot be restored by name, like
+// user-defined ones, are skipped, so a loaded entry never binds a name to another definition.
+// Returns the number of saved entries.
+template<class Op> size_t save(const detail::memo_scope<Op, expr>& memo, const string& path)
+{
+	detail::expr_writer entries;
+	uint32_t count = 0;
+	memo.table().for_each([&entries, &count](const expr& e, const expr& x, const expr& result) {
+		detail::expr_writer w;
+		w.write(e), w.write(x), w.write(result);
+		if(!w.ok())	return;
+		for(auto c : w.data())	entries.byte((uint8_t)c);
+		entries.u64(w.checksum()), count++;
+	});
+	detail::expr_writer header;
+	for(auto c : detail::memo_magic)	if(c)	header.byte((uint8_t)c);
+	header.u32(detail::memo_version), header.u32(count);
+	std::ofstream os(path, std::ios::binary | std::ios::trunc);
+	os << header.data() << entries.data();
+	return os ? count : 0;
+}
+
+// Loads entries saved by save() into the memo. An entry is accepted only if the restored expressions have
+// the same structural hash, loading stops at the first malformed entry. Returns the number of loaded entries.
+template<class Op> size_t load(detail::memo_scope<Op, expr>& memo, const string& path)
+{
+	std::ifstream is(path, std::ios::binary);
+	detail::expr_reader r(is);
+	size_t loaded = 0;
+	try {
+		for(auto c : detail::memo_magic)	if(c && r.byte() != (uint8_t)c)	return 0;
+		if(r.u32() != detail::memo_version)	return 0;
+		for(auto count = r.u32(); count; count--) {
+			auto e = r.read(), x = r.read(), result = r.read();
+			auto hash = r.u64();
+			detail::expr_writer w;
+			w.write(e), w.write(x), w.write(result);
+			if(w.ok() && w.checksum() == hash)	memo.table().insert(e, x, result), loaded++;
+		}
+	} catch(error_t) {}
+	return loaded;
+}
+
+}
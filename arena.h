@@ -0,0 +1,65 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+namespace cas {
+namespace detail {
+
+// Bump allocator, memory is never returned one by one but released when the pool is destroyed
+class arena_pool
+{
+	static const size_t block_size = 64 * 1024;
+	std::vector<std::unique_ptr<char[]>> _blocks;
+	size_t	_used = 0;
+	size_t	_size = 0;
+	size_t	_bytes = 0;
+public:
+	void* allocate(size_t size, size_t align) {
+		_used = (_used + align - 1) & ~(align - 1);
+		if(_blocks.empty() || _used + size > _size) {
+			_size = size > block_size ? size : block_size;
+			_blocks.emplace_back(new char[_size]);
+			_used = 0;
+		}
+		void* p = _blocks.back().get() + _used;
+		_used += size;
+		_bytes += size;
+		return p;
+	}
+	size_t bytes() const { return _bytes; }
+};
+
+// Every allocation holds the pool, so it lives until the last node allocated from it is gone
+template<class T> struct arena_allocator
+{
+	typedef T value_type;
+	std::shared_ptr<arena_pool> pool;
+	arena_allocator(std::shared_ptr<arena_pool> pool) : pool(std::move(pool)) {}
+	template<class U> arena_allocator(const arena_allocator<U>& a) : pool(a.pool) {}
+	T* allocate(size_t n) { return static_cast<T*>(pool->allocate(n * sizeof(T), alignof(T))); }
+	void deallocate(T* p, size_t n) {}
+	template<class U> bool operator == (const arena_allocator<U>& a) const { return pool == a.pool; }
+	template<class U> bool operator != (const arena_allocator<U>& a) const { return pool != a.pool; }
+};
+
+inline std::shared_ptr<arena_pool>& current_arena() { static std::shared_ptr<arena_pool> pool; return pool; }
+
+}
+
+// Scoped arena: expression nodes created while it is active are bump-allocated from one pool.
+// The pool is released at once when the scope is left and all its nodes are destroyed,
+// results that should outlive the scope are copied out with promote().
+class eval_arena
+{
+	std::shared_ptr<detail::arena_pool> _pool;
+	std::shared_ptr<detail::arena_pool> _prev;
+public:
+	eval_arena() : _pool(std::make_shared<detail::arena_pool>()), _prev(detail::current_arena()) { detail::current_arena() = _pool; }
+	~eval_arena() { detail::current_arena() = _prev; }
+	eval_arena(const eval_arena&) = delete;
+	eval_arena& operator = (const eval_arena&) = delete;
+	size_t bytes() const { return _pool->bytes(); }
+};
+
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <limits>
+#include <memory>
+#include "mpfloat.h"
+
+namespace cas {
+
+// Real ball: midpoint and radius of an interval that is guaranteed to contain the exact value.
+// The midpoint is rounded to the working precision in decimal digits, the error of the rounding and of
+// every operation on mpreal_t is added to the radius. Balls outside of the domain of a function get an
+// infinite radius. Both bounds are kept in one immutable heap block, like the values of multiprecision.
+class ball
+{
+	struct bounds { mpreal_t mid, rad; };
+	std::shared_ptr<const bounds>	_bounds;
+	unsigned						_digits;
+
+	// f(x) for f with |f'| <= slope on the ball, value is f(mid) computed in mpreal_t
+	ball map(const mpreal_t& value, const mpreal_t& slope) const { return {value, rad() * slope + (abs(value) + abs(mid()) + 1) * eps(), _digits}; }
+
+public:
+	// ball without bounds, for results outside of the domain or without a real enclosure
+	static ball undefined(const mpreal_t& mid, unsigned digits) { return {mid, std::numeric_limits<mpreal_t>::infinity(), digits}; }
+	// bound of the relative error of one operation or elementary function on mpreal_t
+	static mpreal_t eps() { return std::numeric_limits<mpreal_t>::epsilon() * 16; }
+
+	ball(const mpreal_t& mid, const mpreal_t& rad, unsigned digits) : _digits(std::min(digits, max_digits)) {
+		auto b = std::make_shared<bounds>();
+		b->mid = detail::round_digits(mid, digits);
+		b->rad = (abs(rad) + abs(mid - b->mid)) * (1 + ldexp(mpreal_t{1}, -28));		// radii need few bits, they are rounded up generously
+		if(isnan(b->rad))	b->rad = std::numeric_limits<mpreal_t>::infinity();
+		_bounds = std::move(b);
+	}
+	const mpreal_t& mid() const { return _bounds->mid; }
+	const mpreal_t& rad() const { return _bounds->rad; }
+	unsigned digits() const { return _digits; }
+	bool contains(const mpreal_t& x) const { return abs(x - mid()) <= rad(); }
+	// radius is within the given number of decimal digits of the midpoint
+	bool accurate(unsigned digits) const { return rad() <= abs(mid()) * pow(mpreal_t{10}, -(int)digits); }
+	std::string str() const { return rad() == 0 ? mid().str(_digits) : mid().str(_digits) + "+/-" + rad().str(2); }
+	size_t hash() const { return boost::hash_value(mid().convert_to<double>()); }
+
+	friend bool operator == (const ball& lh, const ball& rh) { return lh.mid() == rh.mid() && lh.rad() == rh.rad(); }
+	// every point of lh is less than every point of rh
+	friend bool operator < (const ball& lh, const ball& rh) { return lh.mid() + lh.rad() < rh.mid() - rh.rad(); }
+
+	friend ball operator - (const ball& x) { return {-x.mid(), x.rad(), x._digits}; }
+	friend ball operator + (const ball& lh, const ball& rh) {
+		mpreal_t mid = lh.mid() + rh.mid();
+		return {mid, lh.rad() + rh.rad() + abs(mid) * eps(), std::min(lh._digits, rh._digits)};
+	}
+	friend ball operator * (const ball& lh, const ball& rh) {
+		mpreal_t mid = lh.mid() * rh.mid();
+		return {mid, abs(lh.mid()) * rh.rad() + abs(rh.mid()) * lh.rad() + lh.rad() * rh.rad() + abs(mid) * eps(), std::min(lh._digits, rh._digits)};
+	}
+	friend ball inverse(const ball& x) {
+		mpreal_t m = abs(x.mid()), mid = 1 / x.mid();
+		if(m <= x.rad())	return undefined(mid, x._digits);
+		return {mid, x.rad() / (m * (m - x.rad())) + abs(mid) * eps(), x._digits};
+	}
+	friend ball pow(ball x, int n) {
+		ball r{1, 0, x._digits};
+		for(unsigned e = n < 0 ? 0u - (unsigned)n : (unsigned)n; e; e /= 2, x = x * x)	if(e % 2)	r = r * x;
+		return n < 0 ? inverse(r) : r;
+	}
+
+	friend ball exp(const ball& x) { return x.map(exp(x.mid()), exp(x.mid() + x.rad())); }
+	friend ball log(const ball& x) {
+		if(x.mid() <= x.rad())	return undefined(log(abs(x.mid())), x._digits);
+		return x.map(log(x.mid()), 1 / (x.mid() - x.rad()));
+	}
+	friend ball sin(const ball& x) { return x.map(sin(x.mid()), 1); }
+	friend ball cos(const ball& x) { return x.map(cos(x.mid()), 1); }
+	friend ball tan(const ball& x) {
+		mpreal_t c = abs(cos(x.mid())) - x.rad();			// |cos| on the ball is at least c
+		if(c <= 0)	return undefined(tan(x.mid()), x._digits);
+		return x.map(tan(x.mid()), 1 / (c * c));
+	}
+	friend ball asin(const ball& x) {
+		mpreal_t m = abs(x.mid()) + x.rad();
+		if(m >= 1)	return undefined(abs(x.mid()) <= 1 ? asin(x.mid()) : std::numeric_limits<mpreal_t>::quiet_NaN(), x._digits);
+		return x.map(asin(x.mid()), 1 / sqrt(1 - m * m));
+	}
+	friend ball acos(const ball& x) {
+		mpreal_t m = abs(x.mid()) + x.rad();
+		if(m >= 1)	return undefined(abs(x.mid()) <= 1 ? acos(x.mid()) : std::numeric_limits<mpreal_t>::quiet_NaN(), x._digits);
+		return x.map(acos(x.mid()), 1 / sqrt(1 - m * m));
+	}
+	friend ball atan(const ball& x) { return x.map(atan(x.mid()), 1); }
+};
+
+inline size_t hash_value(const ball& x) { return x.hash(); }
+
+}
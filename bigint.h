@@ -0,0 +1,305 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/functional/hash.hpp>
+
+namespace cas {
+
+// Signed integer of arbitrary size: sign and magnitude, 32-bit limbs stored least significant first.
+// Numbers use it only after machine integers overflow, see numeric.h
+class bigint
+{
+	typedef std::vector<uint32_t> limbs_t;
+
+	limbs_t	_mag;					// no leading zero limbs, empty for zero
+	bool	_neg = false;
+
+	static const size_t karatsuba_limbs = 32;	// operands shorter than that are multiplied by the schoolbook method
+
+	void trim() { while(!_mag.empty() && !_mag.back()) _mag.pop_back(); if(_mag.empty()) _neg = false; }
+
+	static int compare(const limbs_t& a, const limbs_t& b) {
+		if(a.size() != b.size())	return a.size() < b.size() ? -1 : 1;
+		for(size_t i = a.size(); i--; )	if(a[i] != b[i])	return a[i] < b[i] ? -1 : 1;
+		return 0;
+	}
+	// r += x·2³²ˢʰⁱᶠᵗ
+	static void add_to(limbs_t& r, const limbs_t& x, size_t shift = 0) {
+		if(r.size() < x.size() + shift)	r.resize(x.size() + shift);
+		uint64_t carry = 0;
+		size_t i = 0;
+		for(; i < x.size(); i++)						carry += (uint64_t)r[i + shift] + x[i], r[i + shift] = (uint32_t)carry, carry >>= 32;
+		for(; carry && i + shift < r.size(); i++)		carry += r[i + shift], r[i + shift] = (uint32_t)carry, carry >>= 32;
+		if(carry)	r.push_back((uint32_t)carry);
+	}
+	// r -= x, r ≥ x
+	static void sub_from(limbs_t& r, const limbs_t& x) {
+		int64_t borrow = 0;
+		size_t i = 0;
+		for(; i < x.size(); i++)				borrow += (int64_t)r[i] - x[i], r[i] = (uint32_t)borrow, borrow >>= 32;
+		for(; borrow && i < r.size(); i++)		borrow += r[i], r[i] = (uint32_t)borrow, borrow >>= 32;
+	}
+	static limbs_t schoolbook(const uint32_t *a, size_t na, const uint32_t *b, size_t nb) {
+		limbs_t r(na + nb);
+		for(size_t i = 0; i < na; i++) {
+			uint64_t carry = 0;
+			for(size_t j = 0; j < nb; j++)	carry += (uint64_t)a[i] * b[j] + r[i + j], r[i + j] = (uint32_t)carry, carry >>= 32;
+			r[i + nb] = (uint32_t)carry;
+		}
+		return r;
+	}
+	// (a₁B+a₀)(b₁B+b₀) = a₁b₁B² + ((a₀+a₁)(b₀+b₁) - a₀b₀ - a₁b₁)B + a₀b₀, three half-size products instead of four
+	static limbs_t multiply(const uint32_t *a, size_t na, const uint32_t *b, size_t nb) {
+		if(na < nb)	std::swap(a, b), std::swap(na, nb);
+		if(nb < karatsuba_limbs)	return schoolbook(a, na, b, nb);
+		size_t h = (na + 1) / 2;
+		if(nb <= h) {									// unbalanced operands: split the longer one only
+			auto r = multiply(a, h, b, nb);
+			add_to(r, multiply(a + h, na - h, b, nb), h);
+			return r;
+		}
+		auto z0 = multiply(a, h, b, h), z2 = multiply(a + h, na - h, b + h, nb - h);
+		limbs_t sa(a, a + h), sb(b, b + h);
+		add_to(sa, limbs_t(a + h, a + na)), add_to(sb, limbs_t(b + h, b + nb));
+		auto z1 = multiply(sa.data(), sa.size(), sb.data(), sb.size());
+		sub_from(z1, z0), sub_from(z1, z2);
+		limbs_t r(z0);
+		add_to(r, z1, h), add_to(r, z2, 2 * h);
+		r.resize(na + nb);
+		return r;
+	}
+	// Long division of magnitudes (Knuth, algorithm 4.3.1 D), v has at least two limbs and u ≥ v
+	static limbs_t divide(const limbs_t& u, const limbs_t& v, limbs_t& rem) {
+		size_t m = u.size(), n = v.size();
+		int s = 0;
+		while(!(v.back() << s & 0x80000000u))	s++;			// normalize so that the top limb of v has its high bit set
+		limbs_t vn(n), un(m + 1), q(m - n + 1);
+		for(size_t i = 0; i < n; i++)	vn[i] = (uint32_t)(((uint64_t)v[i] << 32 | (i ? v[i - 1] : 0)) >> (32 - s));
+		for(size_t i = 0; i <= m; i++)	un[i] = (uint32_t)(((uint64_t)(i < m ? u[i] : 0) << 32 | (i ? u[i - 1] : 0)) >> (32 - s));
+		const uint64_t b = 1ull << 32;
+		for(size_t j = m - n + 1; j--; ) {
+			uint64_t num = (uint64_t)un[j + n] << 32 | un[j + n - 1], qhat = num / vn[n - 1], rhat = num % vn[n - 1];
+			while(qhat >= b || qhat * vn[n - 2] > (rhat << 32 | un[j + n - 2])) {
+				qhat--, rhat += vn[n - 1];
+				if(rhat >= b)	break;
+			}
+			int64_t k = 0, t;
+			for(size_t i = 0; i < n; i++) {
+				uint64_t p = qhat * vn[i];
+				t = (int64_t)un[i + j] - k - (int64_t)(p & 0xffffffffu);
+				un[i + j] = (uint32_t)t;
+				k = (int64_t)(p >> 32) - (t >> 32);
+			}
+			t = (int64_t)un[j + n] - k;
+			un[j + n] = (uint32_t)t;
+			q[j] = (uint32_t)qhat;
+			if(t < 0) {											// qhat was one too large, add v back
+				q[j]--;
+				uint64_t c = 0;
+				for(size_t i = 0; i < n; i++)	c += (uint64_t)un[i + j] + vn[i], un[i + j] = (uint32_t)c, c >>= 32;
+				un[j + n] += (uint32_t)c;
+			}
+		}
+		rem.resize(n);
+		for(size_t i = 0; i < n; i++)	rem[i] = (uint32_t)(((uint64_t)un[i + 1] << 32 | un[i]) >> s);
+		return q;
+	}
+
+public:
+	bigint() {}
+	explicit bigint(long long value) : _neg(value < 0) {
+		for(auto m = value < 0 ? 0ull - (unsigned long long)value : (unsigned long long)value; m; m >>= 32)	_mag.push_back((uint32_t)m);
+	}
+	bigint(limbs_t magnitude, bool negative) : _mag(std::move(magnitude)), _neg(negative) { trim(); }
+
+	const limbs_t& limbs() const { return _mag; }
+	bool negative() const { return _neg; }
+	bool is_zero() const { return _mag.empty(); }
+	bool fits_int() const { return _mag.size() <= 1 && (_mag.empty() || _mag[0] <= (_neg ? 0x80000000u : 0x7fffffffu)); }
+	bool fits_ll() const { return _mag.size() <= 2 && (_mag.size() < 2 || _mag[1] < 0x80000000u || (_neg && _mag[1] == 0x80000000u && !_mag[0])); }
+	unsigned long long to_ull() const {				// magnitude modulo 2⁶⁴
+		unsigned long long m = 0;
+		for(size_t i = std::min<size_t>(_mag.size(), 2); i--; )	m = m << 32 | _mag[i];
+		return m;
+	}
+	long long to_ll() const { return _neg ? (long long)(0ull - to_ull()) : (long long)to_ull(); }
+	explicit operator double() const {
+		double d = 0;
+		for(size_t i = _mag.size(); i--; )	d = d * 4294967296.0 + _mag[i];
+		return _neg ? -d : d;
+	}
+	// Value as m·2ᵉ with the top 96 bits in m, so ratios of numbers beyond the double range can be approximated
+	double scaled(long& e) const {
+		size_t top = std::min<size_t>(_mag.size(), 3);
+		double d = 0;
+		for(size_t i = _mag.size(); i-- > _mag.size() - top; )	d = d * 4294967296.0 + _mag[i];
+		e = 32 * (long)(_mag.size() - top);
+		return _neg ? -d : d;
+	}
+
+	// Divides the magnitude by d in place and returns the remainder
+	uint32_t div_small(uint32_t d) {
+		uint64_t r = 0;
+		for(size_t i = _mag.size(); i--; )	r = r << 32 | _mag[i], _mag[i] = (uint32_t)(r / d), r %= d;
+		trim();
+		return (uint32_t)r;
+	}
+	// Truncating division by v ≠ 0: the quotient is rounded toward zero, the remainder has the sign of the dividend
+	static bigint divmod(const bigint& u, const bigint& v, bigint& rem) {
+		bigint q;
+		if(compare(u._mag, v._mag) < 0) {
+			rem = u;
+			return q;
+		}
+		if(v._mag.size() == 1) {
+			q = u;
+			rem = bigint{(long long)q.div_small(v._mag[0])};
+		} else
+			q._mag = divide(u._mag, v._mag, rem._mag);
+		q._neg = u._neg != v._neg, rem._neg = u._neg;
+		q.trim(), rem.trim();
+		return q;
+	}
+	bigint pow(unsigned e) const {
+		bigint r{1}, x = *this;
+		for(; e; e >>= 1) {
+			if(e & 1)	r = r * x;
+			if(e > 1)	x = x * x;
+		}
+		return r;
+	}
+	std::string str() const {
+		if(_mag.empty())	return "0";
+		std::string s;
+		bigint t = *this;
+		while(!t.is_zero()) {
+			auto r = t.div_small(1000000000u);
+			for(int i = 0; i < 9 && (r || !t.is_zero()); i++, r /= 10)	s.push_back(char('0' + r % 10));
+		}
+		if(_neg)	s.push_back('-');
+		return std::string(s.rbegin(), s.rend());
+	}
+	size_t hash() const { size_t seed = _neg; boost::hash_range(seed, _mag.begin(), _mag.end()); return seed; }
+
+	friend bigint operator - (bigint x) { if(!x.is_zero()) x._neg = !x._neg; return x; }
+	friend bigint operator + (const bigint& lh, const bigint& rh) {
+		if(lh._neg == rh._neg)	{ bigint r = lh; add_to(r._mag, rh._mag); return r; }
+		if(compare(lh._mag, rh._mag) >= 0)	{ bigint r = lh; sub_from(r._mag, rh._mag); r.trim(); return r; }
+		bigint r = rh; sub_from(r._mag, lh._mag); r.trim(); return r;
+	}
+	friend bigint operator - (const bigint& lh, const bigint& rh) { return lh + -rh; }
+	friend bigint operator * (const bigint& lh, const bigint& rh) {
+		if(lh.is_zero() || rh.is_zero())	return {};
+		return {multiply(lh._mag.data(), lh._mag.size(), rh._mag.data(), rh._mag.size()), lh._neg != rh._neg};
+	}
+	friend bigint operator / (const bigint& lh, const bigint& rh) { bigint r; return divmod(lh, rh, r); }
+	friend bigint operator % (const bigint& lh, const bigint& rh) { bigint r; divmod(lh, rh, r); return r; }
+	friend bigint gcd(bigint a, bigint b) {
+		a._neg = b._neg = false;
+		while(!b.is_zero()) {
+			if(a._mag.size() <= 2 && b._mag.size() <= 2) {	// the rest fits in machine words
+				uint64_t x = a.to_ull(), y = b.to_ull();
+				while(y)	x %= y, std::swap(x, y);
+				return bigint{{(uint32_t)x, (uint32_t)(x >> 32)}, false};
+			}
+			a = a % b, std::swap(a, b);
+		}
+		return a;
+	}
+	friend bool operator == (const bigint& lh, const bigint& rh) { return lh._neg == rh._neg && lh._mag == rh._mag; }
+	friend bool operator != (const bigint& lh, const bigint& rh) { return !(lh == rh); }
+	friend bool operator < (const bigint& lh, const bigint& rh) {
+		if(lh._neg != rh._neg)	return lh._neg;
+		return lh._neg ? compare(rh._mag, lh._mag) < 0 : compare(lh._mag, rh._mag) < 0;
+	}
+	friend std::ostream& operator << (std::ostream& os, const bigint& x) { return os << x.str(); }
+};
+
+inline size_t hash_value(const bigint& x) { return x.hash(); }
+
+// Fraction of big integers, always reduced with a positive denominator. Sums and products cancel common
+// factors of the operands before multiplying (Knuth, 4.5.1), so the results need no full gcd of their own.
+class bigrat
+{
+	bigint	_numer;
+	bigint	_denom{1};
+
+	bigrat(bigint numer, bigint denom, bool) : _numer(std::move(numer)), _denom(std::move(denom)) {
+		if(_denom.negative())	_numer = -_numer, _denom = -_denom;
+	}
+
+public:
+	bigrat() {}
+	bigrat(bigint numer, bigint denom) : bigrat(std::move(numer), std::move(denom), true) {
+		auto d = gcd(_numer, _denom);
+		if(d != bigint{1})	_numer = _numer / d, _denom = _denom / d;
+	}
+	// Fraction of coprime numbers, only the sign is normalized
+	static bigrat reduced(bigint numer, bigint denom) { return {std::move(numer), std::move(denom), true}; }
+
+	const bigint& numer() const { return _numer; }
+	const bigint& denom() const { return _denom; }
+	explicit operator double() const {
+		long en, ed;
+		double n = _numer.scaled(en), d = _denom.scaled(ed);
+		return std::ldexp(n / d, (int)(en - ed));
+	}
+	std::string str() const { return _numer.str() + "/" + _denom.str(); }
+	size_t hash() const { size_t seed = _numer.hash(); boost::hash_combine(seed, _denom.hash()); return seed; }
+
+	friend bigrat operator - (const bigrat& x) { return reduced(-x._numer, x._denom); }
+	friend bigrat operator + (const bigrat& lh, const bigrat& rh) {
+		if(lh._numer.is_zero())	return rh;
+		if(rh._numer.is_zero())	return lh;
+		auto g = gcd(lh._denom, rh._denom);
+		if(g == bigint{1})	return reduced(lh._numer * rh._denom + rh._numer * lh._denom, lh._denom * rh._denom);
+		auto t = lh._numer * (rh._denom / g) + rh._numer * (lh._denom / g), g2 = gcd(t, g);
+		if(t.is_zero())		return {};
+		if(g2 == bigint{1})	return reduced(std::move(t), lh._denom / g * rh._denom);
+		return reduced(t / g2, lh._denom / g * (rh._denom / g2));
+	}
+	friend bigrat operator * (const bigrat& lh, const bigrat& rh) {
+		if(lh._numer.is_zero() || rh._numer.is_zero())	return {};
+		auto g1 = gcd(lh._numer, rh._denom), g2 = gcd(rh._numer, lh._denom);
+		return reduced(lh._numer / g1 * (rh._numer / g2), lh._denom / g2 * (rh._denom / g1));
+	}
+	friend bigrat inverse(const bigrat& x) { return {x._denom, x._numer, true}; }
+	friend bool operator == (const bigrat& lh, const bigrat& rh) { return lh._numer == rh._numer && lh._denom == rh._denom; }
+	friend bool operator < (const bigrat& lh, const bigrat& rh) { return lh._numer * rh._denom < rh._numer * lh._denom; }
+};
+
+inline size_t hash_value(const bigrat& x) { return x.hash(); }
+
+// Gaussian rational: exact complex number with fractional real and imaginary parts
+// Both parts are kept in one immutable heap block, so the alternative does not widen numeric_t
+class gaussian
+{
+	std::shared_ptr<const std::pair<bigrat, bigrat>>	_parts;
+public:
+	gaussian(bigrat re, bigrat im) : _parts(std::make_shared<const std::pair<bigrat, bigrat>>(std::move(re), std::move(im))) {}
+	const bigrat& re() const { return _parts->first; }
+	const bigrat& im() const { return _parts->second; }
+	bigrat norm() const { return re() * re() + im() * im(); }
+	size_t hash() const { size_t seed = re().hash(); boost::hash_combine(seed, im().hash()); return seed; }
+
+	friend gaussian operator + (const gaussian& lh, const gaussian& rh) { return {lh.re() + rh.re(), lh.im() + rh.im()}; }
+	friend gaussian operator * (const gaussian& lh, const gaussian& rh) { return {lh.re() * rh.re() + -(lh.im() * rh.im()), lh.re() * rh.im() + lh.im() * rh.re()}; }
+	friend gaussian inverse(const gaussian& x) { auto n = inverse(x.norm()); return {x.re() * n, -x.im() * n}; }		// x ≠ 0
+	friend gaussian pow(gaussian x, unsigned e) {
+		gaussian r{bigrat::reduced(bigint{1}, bigint{1}), {}};
+		for(; e; e /= 2, x = x * x)	if(e % 2)	r = r * x;
+		return r;
+	}
+	friend bool operator == (const gaussian& lh, const gaussian& rh) { return lh._parts == rh._parts || lh.re() == rh.re() && lh.im() == rh.im(); }
+};
+
+inline size_t hash_value(const gaussian& x) { return x.hash(); }
+
+}
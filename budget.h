@@ -0,0 +1,70 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace cas {
+
+// Limits of one evaluation: created nodes, nesting of recursive operations and wall-clock time
+struct eval_limits
+{
+	size_t	nodes = SIZE_MAX;
+	size_t	depth = SIZE_MAX;
+	std::chrono::milliseconds	time = std::chrono::milliseconds::max();
+};
+
+namespace detail {
+
+[[noreturn]] void budget_exceeded();
+
+struct budget_state
+{
+	size_t	max_nodes, max_depth;
+	std::chrono::steady_clock::time_point	deadline;
+	size_t	nodes = 0, depth = 0, ticks = 0;
+
+	explicit budget_state(const eval_limits& limits) : max_nodes(limits.nodes), max_depth(limits.depth),
+		deadline(limits.time == std::chrono::milliseconds::max() ? std::chrono::steady_clock::time_point::max() : std::chrono::steady_clock::now() + limits.time) {}
+
+	// the clock is read once in 256 checks, other checks only increment counters
+	void tick() { if(++ticks % 256 == 0 && std::chrono::steady_clock::now() > deadline)	budget_exceeded(); }
+	void node() { if(++nodes > max_nodes)	budget_exceeded(); tick(); }
+};
+
+inline budget_state*& current_budget() { static budget_state *state = nullptr; return state; }
+inline void charge_node() { if(auto b = current_budget())	b->node(); }
+inline void check_budget() { if(auto b = current_budget())	b->tick(); }
+
+// Nesting level of a recursive operation
+class depth_guard
+{
+	budget_state	*_state;
+public:
+	depth_guard() : _state(current_budget()) {
+		if(!_state)	return;
+		if(++_state->depth > _state->max_depth)	_state->depth--, budget_exceeded();
+		_state->tick();
+	}
+	~depth_guard() { if(_state) _state->depth--; }
+	depth_guard(const depth_guard&) = delete;
+	depth_guard& operator = (const depth_guard&) = delete;
+};
+
+}
+
+// Scoped budget of an evaluation. Operations that exceed it throw error_t::limit,
+// NScript::eval returns it as an error expression.
+class eval_budget
+{
+	detail::budget_state	_state;
+	detail::budget_state	*_prev;
+public:
+	explicit eval_budget(const eval_limits& limits) : _state(limits), _prev(detail::current_budget()) { detail::current_budget() = &_state; }
+	~eval_budget() { detail::current_budget() = _prev; }
+	eval_budget(const eval_budget&) = delete;
+	eval_budget& operator = (const eval_budget&) = delete;
+	size_t nodes() const { return _state.nodes; }
+};
+
+}
@@ -1,9 +1,10 @@
 #pragma once
 
 #include <boost/variant.hpp>
+#include <boost/functional/hash.hpp>
 #include <boost/math/constants/constants.hpp>
-#include <boost/math/special_functions/prime.hpp>
 #include <algorithm>
+#include <numeric>
 #include <iostream>
 #include <vector>
 #include <complex>
@@ -16,59 +17,128 @@
 
 namespace cas {
 	
-inline expr symbol::subst(pair<expr, expr> s) const { 
-	if(is<xset>(s.first) && is<xset>(s.second)) {
-		const auto& from = as<xset>(s.first).items(), to = as<xset>(s.second).items();
-		for(auto pi = from.cbegin(), pf = to.cbegin(); pi != from.cend() && pf != to.cend(); pi++, pf++)
-			if(*pi == expr{*this})	return *pf;
+namespace detail {
+
+// Replaces subexpressions found in a hashed table of rules, the first rule wins for equal keys.
+// Every shared node is visited once and returned as is when nothing below it is replaced,
+// subtrees without free symbols of the rules are skipped.
+class substitution
+{
+	std::vector<pair<expr, expr>>					_rules;
+	std::unordered_multimap<size_t, size_t>			_index;		// hash of rule key -> rule
+	std::unordered_map<string, func>				_funcs;		// function name -> new definition
+	node_memo<expr>									_done;		// visited node -> result
+	symbol_set	_vars;
+	bool		_prune = true;
+
+	const expr *find(const expr& e) const {
+		auto range = _index.equal_range(hash_of(e));
+		for(auto it = range.first; it != range.second; ++it)	if(_rules[it->second].first == e)	return &_rules[it->second].second;
+		return nullptr;
 	}
-	return expr{*this} == s.first ? s.second : *this; 
-}
-inline expr power::subst(pair<expr, expr> s) const { return expr{*this} == s.first ? s.second : (_x | s) ^ (_y | s); }
-inline expr product::subst(pair<expr, expr> s) const { return expr{*this} == s.first ? s.second : (_left | s) * (_right | s); }
-inline expr sum::subst(pair<expr, expr> s) const { return expr{*this} == s.first ? s.second : (_left | s) + (_right | s); }
-inline expr xset::subst(pair<expr, expr> s) const {
-	if(expr{*this} == s.first)	return s.second;
-	list_t ret;
-	transform(_items.begin(), _items.end(), back_inserter(ret), [s](auto e) {return e | s; });
-	return{ret};
+	bool map(const list_t& items, list_t& ret) {
+		bool changed = false;
+		for(auto& e : items)	ret.push_back(apply(e)), changed |= !identical(ret.back(), e);
+		return changed;
+	}
+
+	expr rebuild(const error& e)	{ return e; }
+	expr rebuild(const numeric& n)	{ return n; }
+	expr rebuild(const symbol& s)	{ return s; }
+	expr rebuild(const power& p) {
+		auto x = apply(p.x()), y = apply(p.y());
+		return identical(x, p.x()) && identical(y, p.y()) ? expr{p} : x ^ y;
+	}
+	expr rebuild(const product& p)	{ list_t items; return map(p.items(), items) ? product::make(std::move(items)) : p; }
+	expr rebuild(const sum& s)		{ list_t items; return map(s.items(), items) ? sum::make(std::move(items)) : s; }
+	expr rebuild(const xset& s)		{ list_t items; return map(s.items(), items) ? xset(std::move(items)) : s; }
+	expr rebuild(const func& f) {
+		auto x = apply(f.x());
+		return identical(x, f.x()) ? expr{f} : f.impl()->make(f, x);
+	}
+
+public:
+	substitution(const pair<expr, expr>& s) {
+		if(is<xset>(s.first) && is<xset>(s.second)) {
+			const auto& from = as<xset>(s.first).items(), to = as<xset>(s.second).items();
+			for(size_t i = 0; i < from.size() && i < to.size(); i++)	add(from[i], to[i]);
+		}	else	add(s.first, s.second);
+	}
+
+	void add(const expr& from, const expr& to) {
+		if(find(from))	return;
+		if(is<symbol>(from) && is<func>(to))	_funcs.emplace(as<symbol>(from).name(), as<func>(to)), _prune = false;
+		if(free_vars(from).empty())	_prune = false;
+		_vars |= free_vars(from);
+		_index.emplace(hash_of(from), _rules.size());
+		_rules.emplace_back(from, to);
+	}
+
+	expr apply(const expr& e) {
+		depth_guard depth;
+		if(is<func>(e) && !_funcs.empty()) {
+			auto& f = as<func>(e);
+			auto it = _funcs.find(f.name());
+			if(it != _funcs.end() && it->second.name() == f.name() && it->second.args().size() == f.args().size())	return it->second(f.x());
+		}
+		if(is<numeric>(e) || is<error>(e))	return e;
+		if(auto to = find(e))	return *to;
+		if(_prune && !free_vars(e).intersects(_vars))	return e;
+		return _done(e, [this](const expr& e) { return boost::apply_visitor([this](const auto& x) { return rebuild(x); }, e); });
+	}
+};
+
 }
 
-inline expr symbol::approx() const { return _value == empty ? expr{*this} : ~_value; }
-inline expr power::approx() const { return ~_x ^ ~_y; }
-inline expr product::approx() const { return ~_left * ~_right; }
-inline expr sum::approx() const { return ~_left + ~_right; }
+inline expr symbol::subst(const pair<expr, expr>& s) const { return detail::substitution{s}.apply(*this); }
+inline expr power::subst(const pair<expr, expr>& s) const { return detail::substitution{s}.apply(*this); }
+inline expr product::subst(const pair<expr, expr>& s) const { return detail::substitution{s}.apply(*this); }
+inline expr sum::subst(const pair<expr, expr>& s) const { return detail::substitution{s}.apply(*this); }
+inline expr xset::subst(const pair<expr, expr>& s) const { return detail::substitution{s}.apply(*this); }
+inline expr func::subst(const pair<expr, expr>& s) const { return detail::substitution{s}.apply(*this); }
+
+inline expr symbol::approx() const {
+	if(auto digits = detail::current_digits()) {						// constants are known to any precision
+		auto constant = [digits](const mpreal_t& x) { return detail::enclosing() ? make_num(ball{x, x * ball::eps(), digits}) : make_num(mpreal{x, digits}); };
+		if(sid() == as<symbol>(pi).sid())	return constant(boost::math::constants::pi<mpreal_t>());
+		if(sid() == as<symbol>(e).sid())	return constant(boost::math::constants::e<mpreal_t>());
+	}
+	return value() == empty ? expr{*this} : ~value();
+}
+inline expr power::approx() const { return ~x() ^ ~y(); }
+inline expr product::approx() const { return combine([](const expr& e) { return ~e; }); }
+inline expr sum::approx() const { return combine([](const expr& e) { return ~e; }); }
 inline expr xset::approx() const {
 	list_t ret;
-	transform(_items.begin(), _items.end(), back_inserter(ret), [](auto e) {return ~e; });
+	transform(items().begin(), items().end(), back_inserter(ret), [](const expr& e) {return ~e; });
 	return{ret};
 }
 
-inline expr symbol::simplify() const { return _value == empty || _name.front() == '#' ? expr{*this} : *_value; }
-inline expr power::simplify() const { return *_x ^ *_y; }
-inline expr product::simplify() const { return *_left * *_right; }
-inline expr sum::simplify() const { return *_left + *_right; }
+inline expr symbol::simplify() const { return value() == empty || sid() < detail::symbol_table::reserved ? expr{*this} : *value(); }
+inline expr power::simplify() const { return *x() ^ *y(); }
+inline expr product::simplify() const { return combine([](const expr& e) { return *e; }); }
+inline expr sum::simplify() const { return combine([](const expr& e) { return *e; }); }
 inline expr xset::simplify() const {
 	list_t ret;
-	transform(_items.begin(), _items.end(), back_inserter(ret), [](auto e) {return *e; });
+	transform(items().begin(), items().end(), back_inserter(ret), [](const expr& e) {return *e; });
 	return{ret};
 }
 
-inline bool symbol::match(expr e, match_result& res) const {
+inline bool symbol::match(const expr& e, match_result& res) const {
 	auto it = find(res.matches.begin(), res.matches.end(), *this);
 	if(it == res.matches.end()) {
-		if(_value == empty || _value == e)	res.matches.push_back({_name, e});
+		if(value() == empty || value() == e)	res.matches.push_back({name(), e});
 		else if(expr{*this} != e)	res.found = false;
 	} else {
 		if(e != it->value())	res.found = false;
 	}
 	return res.found;
 }
-inline bool power::match(expr e, match_result& res) const { return is<power>(e) ? cas::match(as<power>(e).y(), _y, res) && cas::match(as<power>(e).x(), _x, res) : res.found = false; }
-inline bool xset::match(expr e, match_result& res) const {
-	if(!is<xset>(e) || as<xset>(e).items().size() != _items.size())	return res.found = false;
+inline bool power::match(const expr& e, match_result& res) const { return is<power>(e) ? cas::match(as<power>(e).y(), y(), res) && cas::match(as<power>(e).x(), x(), res) : res.found = false; }
+inline bool xset::match(const expr& e, match_result& res) const {
+	if(!is<xset>(e) || as<xset>(e).items().size() != items().size())	return res.found = false;
 	auto pe = as<xset>(e).items().begin();
-	for(auto item : _items)	if(!cas::match(*pe++, item, res)) break;
+	for(auto item : items())	if(!cas::match(*pe++, item, res)) break;
 	return res.found;
 }
 
@@ -76,37 +146,53 @@ inline unsigned symbol::exponents(const list_t& vars) const {
 	auto it = find(vars.begin(), vars.end(), expr{*this});
 	return it == vars.end() ? 0 : 70 * pwr(100u, vars.size() - std::distance(vars.begin(), it) - 1);
 }
+namespace detail {
+// Degree of a variable in its power: exponent 1 keeps 70, larger exponents are above, fractional and negative ones below
+inline int exponent_weight(const expr& y, double limit) {
+	double e =	is<numeric, int_t>(y) ? (real_t)as<numeric, int_t>(y) :
+				is<numeric, rational_t>(y) ? (real_t)as<numeric, rational_t>(y) :
+				is<numeric, real_t>(y) ? as<numeric, real_t>(y) : 9.;
+	return (int)(e > 1 ? std::min<>(limit, e+70) : e > -1 ? e*20+50 : std::max<>(0., 30 + e));
+}
+inline uint64_t power_degree(const expr& x, const expr& y) {
+	uint64_t n = exponent_weight(y, (double)degree_max), res = 0, c = degree_of(x);
+	for(uint32_t var = symbol_table::var_x; var <= symbol_table::var_z; var++) {
+		auto s = degree_shift(var);
+		res |= std::min<>(degree_max, (c >> s & degree_max) * n / 70) << s;
+	}
+	return res;
+}
+}
+
 inline unsigned power::exponents(const list_t& vars) const { 
 	unsigned res = 0;
-	double e =	is<numeric, int_t>(_y) ? (real_t)as<numeric, int_t>(_y) :
-				is<numeric, rational_t>(_y) ? (real_t)as<numeric, rational_t>(_y) :
-				is<numeric, real_t>(_y) ? as<numeric, real_t>(_y) : 9.;
-
-	int n = (int)(e > 1 ? std::min<>(99., e+70) : e > -1 ? e*20+50 : std::max<>(0., 30 + e));
+	int n = detail::exponent_weight(y(), 99.);
 
-	for(auto c = get_exps(_x, vars), i = 0u; c; c /= 100, i++) {
+	for(auto c = get_exps(x(), vars), i = 0u; c; c /= 100, i++) {
 		res += pwr(100u, i) * std::min<>(99u, (c % 100) * n / 70);
 	}
 
 	return res; 
 }
-inline unsigned product::exponents(const list_t& vars) const { return get_exps(_left, vars) + get_exps(_right, vars); }
-inline unsigned sum::exponents(const list_t& vars) const { return std::max<>(get_exps(_left, vars), get_exps(_right, vars)); }
+inline unsigned product::exponents(const list_t& vars) const { return std::accumulate(begin(), end(), 0u, [&vars](unsigned s, const expr& e) {return s + get_exps(e, vars); }); }
+inline unsigned sum::exponents(const list_t& vars) const { return std::accumulate(begin(), end(), 0u, [&vars](unsigned s, const expr& e) {return std::max<>(get_exps(e, vars), s); }); }
 inline unsigned xset::exponents(const list_t& vars) const { 
-	return std::accumulate(_items.begin(), _items.end(), 0u, [&vars](unsigned s, expr e) {return std::max<>(get_exps(e, vars), s); });
+	return std::accumulate(items().begin(), items().end(), 0u, [&vars](unsigned s, expr e) {return std::max<>(get_exps(e, vars), s); });
 }
 
+inline uint64_t product::degree(const list_t& items) { return std::accumulate(items.begin(), items.end(), uint64_t(0), [](uint64_t s, const expr& e) { return detail::add_degrees(s, detail::degree_of(e)); }); }
+inline uint64_t sum::degree(const list_t& items) { return std::accumulate(items.begin(), items.end(), uint64_t(0), [](uint64_t s, const expr& e) { return std::max<>(detail::degree_of(e), s); }); }
+
 inline bool prod_comp::operator ()(const expr& left, const expr& right) const
 {
-	//auto l = get_exps(left, variables), r = get_exps(right, variables);
-	//return l != r ? l < r : left < right;
-	return left < right;
+	auto l = detail::order_key(left, false), r = detail::order_key(right, false);
+	return l != r ? l < r : left < right;
 }
 
 inline bool sum_comp::operator ()(const expr& left, const expr& right) const
 {
-	auto l = get_exps(left, variables), r = get_exps(right, variables);
-	return l != r ? l > r : left <= right;
+	auto l = detail::order_key(left, true), r = detail::order_key(right, true);
+	return l != r ? l < r : left < right;
 }
 
 inline expr operator ~ (expr op1) { return cas::approx(op1); }
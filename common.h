@@ -1,5 +1,10 @@
 #pragma once
+#include "intern.h"
 #include "expr_list.h"
+#include "memo.h"
+#include "bigint.h"
+#include "mpfloat.h"
+#include "ball.h"
 
 using std::string;
 using std::ostream;
@@ -23,37 +28,45 @@ class rational_t;
 class numeric;
 class symbol;
 class func;
-class func;
 class power;
 class product;
 class sum;
 class xset;
 class error;
 
+namespace detail {
+struct symbol_node;
+struct power_node;
+struct xset_node;
+struct func_node;
+}
+
 using int_t = int;
 using real_t = double;
 using complex_t = std::complex<real_t>;
 
-using numeric_t = boost::variant<int_t, rational_t, real_t, complex_t>;
+using numeric_t = boost::variant<int_t, rational_t, real_t, complex_t, bigint, bigrat, mpreal, mpcomplex, ball, gaussian>;
 using expr = boost::variant<
 	error,
 	numeric,
-	boost::recursive_wrapper<symbol>,
-	boost::recursive_wrapper<func>,
-	boost::recursive_wrapper<power>,
-	boost::recursive_wrapper<product>,
-	boost::recursive_wrapper<sum>,
-	boost::recursive_wrapper<xset>
+	symbol,
+	func,
+	power,
+	product,
+	sum,
+	xset
 >;
 
 using list_t = std::vector<expr>;
-using fmake_t = std::function<expr(expr)>;
+using fmake_t = std::function<expr(expr, expr)>;
 using fcall_t = std::function<expr(expr, expr)>;
 using fprint_t = std::function<ostream&(ostream& os, const func&)>;
 
 enum class part_t { all = 0, num = 1, den = 2 };
-enum class error_t { cast, invalid_args, not_implemented, syntax, empty };
-static const char * error_msgs[] = {"Invalid cast", "Invalid arguments", "Not implemented", "Syntax error", "Empty"};
+enum class error_t { cast, invalid_args, not_implemented, syntax, empty, limit };
+static const char * error_msgs[] = {"Invalid cast", "Invalid arguments", "Not implemented", "Syntax error", "Empty", "Resource limit exceeded"};
+
+inline void detail::budget_exceeded() { throw error_t::limit; }
 
 struct match_result
 {
@@ -63,9 +76,11 @@ struct match_result
 	operator bool() { return found; }
 };
 
-bool has_sign(expr e);
-bool less(numeric_t op1, numeric_t op2);
-unsigned get_exps(expr e, const list_t& vars);
+bool has_sign(const expr& e);
+bool depends_on(const expr& e, const symbol& x);
+bool depends_on(const expr& e, const expr& x);
+bool less(const numeric_t& op1, const numeric_t& op2);
+unsigned get_exps(const expr& e, const list_t& vars);
 bool is_mml(ostream& os);
 expr make_err(error_t err);
 expr make_num(int_t value);
@@ -73,9 +88,17 @@ expr make_num(int_t numer, int_t denom);
 expr make_num(real_t value);
 expr make_num(real_t real, real_t imag);
 expr make_num(complex_t value);
+expr make_num(bigint value);
+expr make_num(bigrat value);
+expr make_num(mpreal value);
+expr make_num(mpcomplex value);
+expr make_num(ball value);
+expr make_num(gaussian value);
 expr make_power(expr x, expr y);
 expr make_sum(expr x, expr y);
+expr make_sum(list_t terms);
 expr make_prod(expr left, expr right);
+expr make_prod(list_t factors);
 expr make_dif(expr f, expr dx);
 expr make_int(expr f, expr dx);
 expr make_intd(expr f, expr dx, expr a, expr b);
@@ -94,8 +117,10 @@ class rational_t
 {
 	int_t	_numer = {0};
 	int_t	_denom = {1};
+	rational_t() {}
 public:
 	rational_t(int_t numer, int_t denom);
+	static rational_t reduced(int_t numer, int_t denom) { rational_t r; r._numer = numer, r._denom = denom; return r; }	// coprime, denom ≥ 0
 	int_t numer() const { return _numer; }
 	int_t denom() const { return _denom; }
 	operator real_t() const { return value(); }
@@ -109,7 +134,7 @@ public:
 };
 
 inline bool operator == (rational_t lh, rational_t rh) { return lh.numer() == rh.numer() && lh.denom() == rh.denom(); }
-inline bool operator < (rational_t lh, rational_t rh) { return lh.numer() * rh.denom() < rh.numer() * lh.denom(); }
+inline bool operator < (rational_t lh, rational_t rh) { return (long long)lh.numer() * rh.denom() < (long long)rh.numer() * lh.denom(); }
 
 class error
 {
@@ -119,12 +144,12 @@ public:
 	error(error_t err) : _error(err) {}
 	error_t get() const { return _error; }
 	bool has_sign() const { return false; }
-	expr d(expr dx) const;
-	expr integrate(expr dx, expr c) const;
+	expr d(const expr& dx) const;
+	expr integrate(const expr& dx, const expr& c) const;
 	expr approx() const;
 	expr simplify() const;
-	expr subst(pair<expr, expr> s) const;
-	bool match(expr e, match_result& res) const;
+	expr subst(const pair<expr, expr>& s) const;
+	bool match(const expr& e, match_result& res) const;
 	unsigned exponents(const list_t& vars) const;
 };
 
@@ -141,185 +166,339 @@ public:
 	numeric(rational_t value) : _value(value) {}
 	numeric(int_t numer, int_t denom) : _value(rational_t{numer, denom}) {}
 	numeric(complex_t value) : _value(value) {}
+	numeric(bigint value) : _value(value.fits_int() ? numeric_t{(int_t)value.to_ll()} : numeric_t{std::move(value)}) {}
+	numeric(bigrat value) : _value(std::move(value)) {}
+	numeric(mpreal value) : _value(std::move(value)) {}
+	numeric(mpcomplex value) : _value(std::move(value)) {}
+	numeric(ball value) : _value(std::move(value)) {}
+	numeric(gaussian value) : _value(std::move(value)) {}
 
 	numeric_t value() const { return _value; }
 	bool has_sign() const { return less(_value, numeric_t{0}); }
-	expr d(expr dx) const;
-	expr integrate(expr dx, expr c) const;
-	expr subst(pair<expr, expr> s) const;
+	expr d(const expr& dx) const;
+	expr integrate(const expr& dx, const expr& c) const;
+	expr subst(const pair<expr, expr>& s) const;
 	expr approx() const;
 	expr simplify() const;
-	bool match(expr e, match_result& res) const;
+	bool match(const expr& e, match_result& res) const;
 	unsigned exponents(const list_t& vars) const;
 };
 inline bool operator == (numeric lh, numeric rh) { return lh.value() == rh.value(); }
 inline bool operator < (numeric lh, numeric rh) { return less(lh.value(), rh.value()); }
 
-class symbol
+class symbol : public detail::shared_node<detail::symbol_node>
 {
-	string	_name;
-	expr	_value;
 public:
-	explicit symbol(string name) : _name(name), _value(error_t::empty) {}
-	symbol(string name, expr value) : _name(name), _value(value) {}
-	string name() const { return _name; }
-	expr value() const { return _value; }
-	symbol operator = (expr value) { _value = value; return *this; }
+	explicit symbol(string name);
+	symbol(string name, expr value);
+	symbol(uint32_t sid, expr value);
+	uint32_t sid() const;
+	const string& name() const;
+	const expr& value() const;
+	symbol operator = (expr value);
 	bool has_sign() const { return false; }
-	expr d(expr dx) const;
-	expr integrate(expr dx, expr c) const;
-	expr subst(pair<expr, expr> s) const;
+	expr d(const expr& dx) const;
+	expr integrate(const expr& dx, const expr& c) const;
+	expr subst(const pair<expr, expr>& s) const;
 	expr approx() const;
 	expr simplify() const;
-	bool match(expr e, match_result& res) const;
+	bool match(const expr& e, match_result& res) const;
 	unsigned exponents(const list_t& vars) const;
 };
 
-inline bool operator == (symbol lh, symbol rh) { return lh.name() == rh.name(); }
-inline bool operator < (symbol lh, symbol rh) { return lh.name() < rh.name(); }
-
-class power
+class power : public detail::shared_node<detail::power_node>
 {
-	expr _x;
-	expr _y;
 public:
-	power(expr x, expr y) : _x(x), _y(y) {}
-	expr x() const { return _x; }
-	expr y() const { return _y; }
-	bool has_sign() const { return cas::has_sign(_x); }
-	expr d(expr dx) const;
-	expr integrate(expr dx, expr c) const;
-	expr subst(pair<expr, expr> s) const;
+	power(expr x, expr y);
+	const expr& x() const;
+	const expr& y() const;
+	bool has_sign() const;
+	expr d(const expr& dx) const;
+	expr integrate(const expr& dx, const expr& c) const;
+	expr subst(const pair<expr, expr>& s) const;
 	expr approx() const;
 	expr simplify() const;
-	bool match(expr e, match_result& res) const;
+	bool match(const expr& e, match_result& res) const;
 	unsigned exponents(const list_t& vars) const;
 };
 
-inline bool operator == (power lh, power rh) { return lh.x() == rh.x() && lh.y() == rh.y(); }
-inline bool operator < (power lh, power rh) { return lh.y() == rh.y() ? lh.x() < rh.x() : lh.y() < rh.y(); }
-inline ostream& operator << (ostream& os, power p);
-
 struct prod_comp { bool operator ()(const expr& left, const expr& right) const; };
 class product : public detail::expr_list<product, expr, prod_comp>
 {
 public:
-	static expr unit() { return{1}; }
+	static expr unit();
 	static expr op(const expr& lh, const expr& rh);
-
-	product(expr left, expr right) : expr_list(std::move(left), std::move(right)) {}
-	bool has_sign() const { return cas::has_sign(_left); }
-	expr d(expr dx) const;
-	expr integrate(expr dx, expr c) const;
-	expr subst(pair<expr, expr> s) const;
+	static size_t key(const expr& e);
+	static expr make(list_t items);
+	static uint64_t degree(const list_t& items);
+
+	product(expr left, expr right);
+	explicit product(list_t items);
+	bool has_sign() const;
+	expr d(const expr& dx) const;
+	expr integrate(const expr& dx, const expr& c) const;
+	expr subst(const pair<expr, expr>& s) const;
 	expr approx() const;
 	expr simplify() const;
 	unsigned exponents(const list_t& vars) const;
 };
 
-inline bool operator == (product lh, product rh) { return lh.left() == rh.left() && lh.right() == rh.right(); }
-inline bool operator < (product lh, product rh) { return lh.right() == rh.right() ? lh.left() < rh.left() : lh.right() < rh.right(); }
-inline ostream& operator << (ostream& os, product p);
-
 struct sum_comp { bool operator ()(const expr& left, const expr& right) const; };
 class sum : public detail::expr_list<sum, expr, sum_comp>
 {
 public:
-	static expr unit() { return{0}; }
+	static expr unit();
 	static expr op(const expr& lh, const expr& rh);
-
-	sum(expr left, expr right) : expr_list(std::move(left), std::move(right)) {}
-	bool has_sign() const { return cas::has_sign(_left); }
-	expr d(expr dx) const;
-	expr integrate(expr dx, expr c) const;
-	expr subst(pair<expr, expr> s) const;
+	static size_t key(const expr& e);
+	static expr make(list_t items);
+	static uint64_t degree(const list_t& items);
+
+	sum(expr left, expr right);
+	explicit sum(list_t items);
+	bool has_sign() const;
+	expr d(const expr& dx) const;
+	expr integrate(const expr& dx, const expr& c) const;
+	expr subst(const pair<expr, expr>& s) const;
 	expr approx() const;
 	expr simplify() const;
 	unsigned exponents(const list_t& vars) const;
 };
 
-inline bool operator == (sum lh, sum rh) { return lh.left() == rh.left() && lh.right() == rh.right(); }
-inline bool operator < (sum lh, sum rh) { return lh.right() == rh.right() ? lh.left() < rh.left() : lh.right() < rh.right(); }
-part_t get_part(ostream& os);
-inline ostream& operator << (ostream& os, sum s) {
-	if(is_mml(os)) {
-		auto part = get_part(os);
-		if(part == part_t::den)	return os;
-		os << part_t::all << "<mrow>" << s.left();
-		if(!has_sign(s.right()))	os << "<mo>&plus;</mo>";
-		return os << s.right() << "</mrow>" << part;
-	} else {
-		os << s.left();
-		if(!has_sign(s.right()))	os << '+';
-		return os << s.right();
-	}
-}
-
-class xset
+class xset : public detail::shared_node<detail::xset_node>
 {
-	list_t	_items;
 public:
-	xset(const xset& x) { _items = x.items(); }
-	xset(expr item) { _items.push_back(item); }
-	xset(const list_t& items) : _items(items) {}
-	xset(list_t&& items) : _items(items) {}
-	xset(std::initializer_list<expr> items) : _items(std::move(items)) {}
-	const list_t& items() const { return _items; }
+	xset(expr item);
+	xset(const list_t& items);
+	xset(list_t&& items);
+	xset(std::initializer_list<expr> items);
+	const list_t& items() const;
 	bool has_sign() const { return false; }
-	expr d(expr dx) const;
-	expr integrate(expr dx, expr c) const;
-	expr subst(pair<expr, expr> s) const;
+	expr d(const expr& dx) const;
+	expr integrate(const expr& dx, const expr& c) const;
+	expr subst(const pair<expr, expr>& s) const;
 	expr approx() const;
 	expr simplify() const;
-	bool match(expr e, match_result& res) const;
+	bool match(const expr& e, match_result& res) const;
 	unsigned exponents(const list_t& vars) const;
 };
 
-inline bool operator == (xset lh, xset rh) { return lh.items() == rh.items(); }
-inline bool operator < (xset lh, xset rh) { return lh.items() < rh.items(); }
-
 ostream& print_fun(ostream& os, const func& f);
 expr approx_fun(expr f, expr x);
 
-class func
+class func : public detail::shared_node<detail::func_node>
 {
 public:
+	// Function descriptor, shared by all nodes of the same function
 	struct callbacks {
-		callbacks(fmake_t m, fcall_t d = make_dif, fcall_t i = make_int, fcall_t a = approx_fun, fprint_t p = print_fun) : make(m), d(d), integrate(i), approx(a), print(p) {}
+		callbacks(fmake_t m, fcall_t d = make_dif, fcall_t i = make_int, fcall_t a = approx_fun, fprint_t p = print_fun, detail::symbol_set v = {}) : make(m), d(d), integrate(i), approx(a), print(p), vars(std::move(v)) {}
+		callbacks(expr m(expr), fcall_t d = make_dif, fcall_t i = make_int, fcall_t a = approx_fun, fprint_t p = print_fun) : callbacks([m](expr f, expr x) { return m(x); }, d, i, a, p) {}
 		fmake_t make;
 		fcall_t d;
 		fcall_t integrate;
 		fcall_t approx;
 		fprint_t print;
+		detail::symbol_set vars;	// symbols the function depends on besides its arguments
 	};
 
-protected:
-	string	  _name;
-	expr	  _args;
-	callbacks _impl;
-public:
 	func(string name, expr args);
 	func(string name, expr args, expr body);
-	func(string name, expr args, callbacks impl) : _name(name), _args(args), _impl(impl) {}
-	string name() const { return _name; }
-	callbacks impl() const { return _impl; }
+	func(string name, expr args, callbacks impl);
+	func(string name, expr args, std::shared_ptr<const callbacks> impl);
+	static std::shared_ptr<const callbacks> define(const string& name, std::shared_ptr<const callbacks> impl);
+	static std::shared_ptr<const callbacks> define(const string& name, callbacks impl);
+	static std::shared_ptr<const callbacks> find(const string& name);
+	const string& name() const;
+	const std::shared_ptr<const callbacks>& impl() const;
 	list_t args() const;
 	bool has_sign() const { return false; }
 	template <typename ... Params> expr operator ()(expr val, Params ... rest) const;
 	expr operator()(expr params) const;
-	expr x() const { return _args; }
-	expr d(expr dx) const;
-	expr integrate(expr dx, expr c) const;
-	expr subst(pair<expr, expr> s) const;
+	const expr& x() const;
+	expr d(const expr& dx) const;
+	expr integrate(const expr& dx, const expr& c) const;
+	expr subst(const pair<expr, expr>& s) const;
 	expr approx() const;
 	expr simplify() const;
 	ostream& print(ostream& os) const;
-	bool match(expr e, match_result& res) const;
+	bool match(const expr& e, match_result& res) const;
 	unsigned exponents(const list_t& vars) const;
 };
 
-inline bool operator == (func lh, func rh) { return lh.name() == rh.name() && lh.args() == rh.args(); }
-inline bool operator < (func lh, func rh) { return lh.name() < rh.name(); }
+namespace detail {
+
+size_t hash_of(const expr& e);
+bool is_loose(const expr& e);
+const symbol_set& free_vars(const expr& e);
+void add_child(node_base& node, const expr& child);
+bool identical(const expr& lh, const expr& rh);
+const void *node_id(const expr& e);
+
+template<class... Args> size_t hash_seq(size_t seed, const Args&... args) {
+	for(auto h : {hash_of(args)...})	boost::hash_combine(seed, h);
+	return seed;
+}
+inline size_t hash_sym(uint32_t sid) {
+	size_t seed = 2;
+	boost::hash_combine(seed, sid);
+	return seed;
+}
+inline size_t hash_list(size_t seed, const list_t& items) {
+	for(auto& e : items)	boost::hash_combine(seed, hash_of(e));
+	return seed;
+}
+
+// Degrees in the canonical variables x, y, z are packed into fields of degree_bits, x in the highest one, so packed
+// degrees compare like the vectors. A variable has degree 70 and powers scale it, see power_degree().
+const unsigned degree_bits = 21;
+const uint64_t degree_max = (uint64_t(1) << degree_bits) - 1;
+uint64_t degree_of(const expr& e);
+uint64_t power_degree(const expr& x, const expr& y);
+inline unsigned degree_shift(uint32_t var) { return degree_bits * (symbol_table::var_z - var); }
+inline uint64_t sym_degree(uint32_t sid) { return sid >= symbol_table::var_x && sid <= symbol_table::var_z ? uint64_t(70) << degree_shift(sid) : 0; }
+// Degree of a product, fields are added and saturate at degree_max
+inline uint64_t add_degrees(uint64_t lh, uint64_t rh) {
+	uint64_t res = 0;
+	for(uint32_t var = symbol_table::var_x; var <= symbol_table::var_z; var++) {
+		auto s = degree_shift(var);
+		res |= std::min<>(degree_max, (lh >> s & degree_max) + (rh >> s & degree_max)) << s;
+	}
+	return res;
+}
+// Leading characters of the name as a number that orders like the names
+inline uint64_t name_rank(const string& name) {
+	uint64_t rank = 0;
+	for(size_t i = 0; i < sizeof(rank); i++)	rank = rank << 8 | (i < name.size() ? (unsigned char)name[i] : 0);
+	return rank;
+}
+
+// Symbols with values are equal to the symbols of the same name without them, reserved constants always hold their values
+struct symbol_node : node_base
+{
+	uint32_t	sid;
+	expr		value;
+	symbol_node(uint32_t sid, expr value) : node_base(hash_sym(sid), sid >= symbol_table::reserved && value != expr{error{}}), sid(sid), value(std::move(value)) {
+		vars.insert(sid);
+		add_child(*this, this->value);
+		degree = sym_degree(sid);
+		rank = name_rank(symbol_table::get().name(sid));
+	}
+};
+
+struct power_node : node_base
+{
+	expr x;
+	expr y;
+	power_node(expr x, expr y) : node_base(hash_seq(4, x, y), is_loose(x) || is_loose(y)), x(std::move(x)), y(std::move(y)) { add_child(*this, this->x); add_child(*this, this->y); degree = power_degree(this->x, this->y); }
+};
+
+struct xset_node : node_base
+{
+	list_t items;
+	xset_node(list_t items) : node_base(hash_list(7, items), std::any_of(items.begin(), items.end(), [](const expr& e) { return is_loose(e); })), items(std::move(items)) { for(auto& e : this->items)	add_child(*this, e), degree = std::max<>(degree, degree_of(e)); }
+};
+
+struct func_node : node_base
+{
+	string								name;
+	expr								args;
+	std::shared_ptr<const func::callbacks>	impl;
+	func_node(string name, expr args, std::shared_ptr<const func::callbacks> impl) : node_base(hash_list(boost::hash_value(name), is<xset>(args) ? as<xset>(args).items() : list_t{args}), is_loose(args)), name(std::move(name)), args(std::move(args)), impl(std::move(impl)) { add_child(*this, this->args); vars |= this->impl->vars; rank = name_rank(this->name); }
+};
+
+inline bool identical(const symbol_node& lh, const symbol_node& rh) { return lh.sid == rh.sid && identical(lh.value, rh.value); }
+inline bool identical(const power_node& lh, const power_node& rh) { return identical(lh.x, rh.x) && identical(lh.y, rh.y); }
+inline bool identical(const xset_node& lh, const xset_node& rh) { return std::equal(lh.items.begin(), lh.items.end(), rh.items.begin(), rh.items.end(), [](const expr& l, const expr& r) { return identical(l, r); }); }
+inline bool identical(const func_node& lh, const func_node& rh) { return lh.impl == rh.impl && lh.name == rh.name && identical(lh.args, rh.args); }
+
+}
+
+inline symbol::symbol(string name) : shared_node({detail::symbol_table::get().id(name), error{error_t::empty}}) {}
+inline symbol::symbol(string name, expr value) : shared_node({detail::symbol_table::get().id(name), std::move(value)}) {}
+inline symbol::symbol(uint32_t sid, expr value) : shared_node({sid, std::move(value)}) {}
+inline uint32_t symbol::sid() const { return node().sid; }
+inline const string& symbol::name() const { return detail::symbol_table::get().name(sid()); }
+inline const expr& symbol::value() const { return node().value; }
+inline symbol symbol::operator = (expr value) { return *this = symbol{sid(), value}; }
+
+inline power::power(expr x, expr y) : shared_node({std::move(x), std::move(y)}) {}
+inline const expr& power::x() const { return node().x; }
+inline const expr& power::y() const { return node().y; }
+inline bool power::has_sign() const { return cas::has_sign(x()); }
+
+inline expr product::unit() { return{1}; }
+inline product::product(expr left, expr right) : expr_list(std::move(left), std::move(right)) {}
+inline product::product(list_t items) : expr_list(std::move(items)) {}
+inline bool product::has_sign() const { return cas::has_sign(left()); }
+
+inline expr sum::unit() { return{0}; }
+inline sum::sum(expr left, expr right) : expr_list(std::move(left), std::move(right)) {}
+inline sum::sum(list_t items) : expr_list(std::move(items)) {}
+inline bool sum::has_sign() const { return cas::has_sign(left()); }
+
+inline xset::xset(expr item) : shared_node(list_t{std::move(item)}) {}
+inline xset::xset(const list_t& items) : shared_node(list_t(items)) {}
+inline xset::xset(list_t&& items) : shared_node(std::move(items)) {}
+inline xset::xset(std::initializer_list<expr> items) : shared_node(list_t(items)) {}
+inline const list_t& xset::items() const { return node().items; }
+
+inline func::func(string name, expr args, callbacks impl) : func(std::move(name), std::move(args), std::make_shared<const callbacks>(std::move(impl))) {}
+inline func::func(string name, expr args, std::shared_ptr<const callbacks> impl) : shared_node({std::move(name), std::move(args), std::move(impl)}) {}
+inline const string& func::name() const { return node().name; }
+inline const std::shared_ptr<const func::callbacks>& func::impl() const { return node().impl; }
+
+namespace detail {
+inline std::unordered_map<string, std::shared_ptr<const func::callbacks>>& func_registry() {
+	static auto registry = new std::unordered_map<string, std::shared_ptr<const func::callbacks>>();	// never destroyed, outlives static expressions
+	return *registry;
+}
+}
+
+// Registry of built-in functions, each is registered once. User-defined functions are kept by the scripts that define them.
+inline std::shared_ptr<const func::callbacks> func::define(const string& name, std::shared_ptr<const callbacks> impl) { return detail::func_registry()[name] = std::move(impl); }
+// Descriptor registered under the name, null if there is none
+inline std::shared_ptr<const func::callbacks> func::find(const string& name) {
+	auto& registry = detail::func_registry();
+	auto it = registry.find(name);
+	return it == registry.end() ? nullptr : it->second;
+}
+inline std::shared_ptr<const func::callbacks> func::define(const string& name, callbacks impl) { return define(name, std::make_shared<const callbacks>(std::move(impl))); }
+inline const expr& func::x() const { return node().args; }
+
+inline bool operator == (const symbol& lh, const symbol& rh) { return lh.id() == rh.id() || lh.sid() == rh.sid(); }
+inline bool operator < (const symbol& lh, const symbol& rh) { return lh.sid() != rh.sid() && lh.name() < rh.name(); }
+inline bool operator == (const power& lh, const power& rh) { return lh.id() == rh.id() || detail::maybe_equal(lh, rh) && lh.x() == rh.x() && lh.y() == rh.y(); }
+inline bool operator < (const power& lh, const power& rh) { return lh.id() != rh.id() && (lh.y() == rh.y() ? lh.x() < rh.x() : lh.y() < rh.y()); }
+inline bool operator == (const product& lh, const product& rh) { return lh.id() == rh.id() || detail::maybe_equal(lh, rh) && lh.items() == rh.items(); }
+inline bool operator < (const product& lh, const product& rh) { return lh.id() != rh.id() && lh.less(rh); }
+inline bool operator == (const sum& lh, const sum& rh) { return lh.id() == rh.id() || detail::maybe_equal(lh, rh) && lh.items() == rh.items(); }
+inline bool operator < (const sum& lh, const sum& rh) { return lh.id() != rh.id() && lh.less(rh); }
+inline bool operator == (const xset& lh, const xset& rh) { return lh.id() == rh.id() || detail::maybe_equal(lh, rh) && lh.items() == rh.items(); }
+inline bool operator < (const xset& lh, const xset& rh) { return lh.id() != rh.id() && lh.items() < rh.items(); }
+inline bool operator == (const func& lh, const func& rh) { return lh.id() == rh.id() || detail::maybe_equal(lh, rh) && lh.impl() == rh.impl() && lh.name() == rh.name() && lh.x() == rh.x(); }
+inline bool operator < (const func& lh, const func& rh) { return lh.id() != rh.id() && (lh.name() != rh.name() ? lh.name() < rh.name() : lh.x() < rh.x()); }
+
+inline ostream& operator << (ostream& os, power p);
+inline ostream& operator << (ostream& os, product p);
+part_t get_part(ostream& os);
+inline ostream& operator << (ostream& os, sum s) {
+	if(is_mml(os)) {
+		auto part = get_part(os);
+		if(part == part_t::den)	return os;
+		os << part_t::all << "<mrow>" << s.left();
+		for(auto it = s.begin() + 1; it != s.end(); ++it) {
+			if(!has_sign(*it))	os << "<mo>&plus;</mo>";
+			os << *it;
+		}
+		return os << "</mrow>" << part;
+	} else {
+		os << s.left();
+		for(auto it = s.begin() + 1; it != s.end(); ++it) {
+			if(!has_sign(*it))	os << '+';
+			os << *it;
+		}
+		return os;
+	}
+}
 inline ostream& operator << (ostream& os, func f) { return f.print(os); }
 
 expr operator + (expr op1, expr op2);
@@ -335,39 +514,172 @@ expr operator | (expr op1, pair<expr, expr> op2);
 
 const expr empty = error{error_t::empty};
 
-inline bool failed(expr e) { return e.type() == typeid(error); }
-inline string to_string(expr e) { std::stringstream ss; ss << e; return ss.str(); }
-inline bool has_sign(expr e) { return boost::apply_visitor([](auto x) { return x.has_sign(); }, e); }
-inline expr subst(expr e, pair<expr, expr> s) { return boost::apply_visitor([s](auto x) { return x.subst(s); }, e); }
-inline expr subst(expr e, expr from, expr to) { return subst(e, std::make_pair(from, to)); }
-inline expr subst(expr e, symbol var)  { return subst(e, var, var.value()); }
-inline expr subst(expr e, list_t vars) { 
+namespace detail { struct df_op; struct int_op; struct approx_op; struct simplify_op; }
+
+// Scoped memo of derivatives, see detail::memo_scope
+using df_cache = detail::memo_scope<detail::df_op, expr>;
+// Scoped memo of antiderivatives without the integration constant, can be saved to a file (see archive.h)
+using int_cache = detail::memo_scope<detail::int_op, expr>;
+
+inline bool failed(const expr& e) { return e.type() == typeid(error); }
+inline string to_string(const expr& e) { std::stringstream ss; ss << e; return ss.str(); }
+inline bool has_sign(const expr& e) { return boost::apply_visitor([](const auto& x) { return x.has_sign(); }, e); }
+inline expr subst(const expr& e, const pair<expr, expr>& s) { return boost::apply_visitor([&s](const auto& x) { return x.subst(s); }, e); }
+inline expr subst(const expr& e, expr from, expr to) { return subst(e, std::make_pair(std::move(from), std::move(to))); }
+inline expr subst(const expr& e, const symbol& var)  { return subst(e, var, var.value()); }
+inline expr subst(const expr& e, const list_t& vars) { 
 	list_t from, to;
 	for(auto& e : vars)	if(is<symbol>(e))	from.push_back(e), to.push_back(as<symbol>(e).value() == empty ? e : as<symbol>(e).value());
 	return subst(e, std::make_pair(expr{from}, expr{to}));
 }
-inline expr df(expr e, expr dx) { return boost::apply_visitor([dx](auto x) { return x.d(dx); }, e); }
-inline expr intf(expr e, expr dx, expr c) { return boost::apply_visitor([dx, c](auto x) { return x.integrate(dx, c); }, e); }
-inline expr intf(expr e, expr dx) { return intf(e, dx, expr{0}); }
-inline expr intf(expr e, expr dx, expr a, expr b) { auto F = intf(e, dx); return is<func>(F) && as<func>(F).name() == S_INT ? make_intd(e, dx, a, b) : subst(F, dx, b) - subst(F, dx, a); }
-inline expr approx(expr e) { return boost::apply_visitor([](auto x) { return x.approx(); }, e); }
-inline expr simplify(expr e) { return boost::apply_visitor([](auto x) { return x.simplify(); }, e); }
-inline bool match(expr e, expr pattern, match_result& res) { return boost::apply_visitor([e, &res](auto x) { return x.match(e, res); }, pattern); }
-inline match_result match(expr e, expr pattern) { match_result res; match(e, pattern, res); return res; }
-inline unsigned get_exps(expr e, const list_t& vars) { return boost::apply_visitor([&vars](auto x) { return x.exponents(vars); }, e); }
-
-inline expr error::subst(pair<expr, expr> s) const { return *this; };
-inline expr error::d(expr dx) const { return *this; };
-inline expr error::integrate(expr dx, expr c) const { return *this; };
+inline expr df(const expr& e, const expr& dx) {
+	return detail::traversal<detail::df_op, expr>::apply(e, dx, [&dx](const expr& e) {
+		auto d = [&dx](const auto& x) { return x.d(dx); };
+		auto memo = df_cache::current().get();
+		if(!memo || is<numeric>(e) || is<symbol>(e))	return boost::apply_visitor(d, e);
+		expr result;
+		if(!memo->find(e, dx, result))	memo->insert(e, dx, result = boost::apply_visitor(d, e));
+		return result;
+	});
+}
+inline expr intf(const expr& e, const expr& dx, const expr& c) {
+	detail::depth_guard depth;
+	auto memo = int_cache::current().get();
+	if(!memo || is<numeric>(e) || is<symbol>(e))	return boost::apply_visitor([&dx, &c](const auto& x) { return x.integrate(dx, c); }, e);
+	expr result;
+	if(!memo->find(e, dx, result))	memo->insert(e, dx, result = boost::apply_visitor([&dx](const auto& x) { return x.integrate(dx, expr{0}); }, e));
+	return c == expr{0} ? result : result + c;
+}
+inline expr intf(const expr& e, const expr& dx) { return intf(e, dx, expr{0}); }
+inline expr intf(const expr& e, const expr& dx, const expr& a, const expr& b) { auto F = intf(e, dx); return is<func>(F) && as<func>(F).name() == S_INT ? make_intd(e, dx, a, b) : subst(F, dx, b) - subst(F, dx, a); }
+inline expr approx(const expr& e) {
+	auto mode = detail::current_digits() * 2 + detail::enclosing();		// results of different precisions are not shared
+	return detail::traversal<detail::approx_op, expr>::apply(e, mode ? expr{numeric{(int_t)mode}} : empty, [](const expr& e) { return boost::apply_visitor([](const auto& x) { return x.approx(); }, e); });
+}
+// Approximation with the given number of decimal digits (up to max_digits), 0 approximates with double
+inline expr approx(const expr& e, unsigned digits) { approx_precision precision(digits); return approx(e); }
+// Ball that contains the value of e with the given number of correct digits. The working precision starts
+// at the target and doubles until the radius is small enough or max_digits is reached. Complex values are
+// approximated without error bounds.
+inline expr approx_interval(const expr& e, unsigned digits) {
+	for(unsigned precision = std::max(digits, 16u); ; precision *= 2) {
+		approx_precision scope(std::min(precision, max_digits), true);
+		auto result = approx(e);
+		if(!is<numeric, ball>(result) || as<numeric, ball>(result).accurate(digits) || precision >= max_digits)	return result;
+	}
+}
+inline expr simplify(const expr& e) {
+	return detail::traversal<detail::simplify_op, expr>::apply(e, empty, [](const expr& e) { return boost::apply_visitor([](const auto& x) { return x.simplify(); }, e); });
+}
+inline bool match(const expr& e, const expr& pattern, match_result& res) { return boost::apply_visitor([&e, &res](const auto& x) { return x.match(e, res); }, pattern); }
+inline match_result match(const expr& e, const expr& pattern) { match_result res; match(e, pattern, res); return res; }
+const list_t variables = {symbol{"x"}, symbol{"y"}, symbol{"z"}};
+
+inline unsigned get_exps(const expr& e, const list_t& vars) { return boost::apply_visitor([&vars](const auto& x) { return x.exponents(vars); }, e); }
+
+namespace detail {
+template<class T> const node_base *base_of(const T& x) { return &x.node(); }
+inline const node_base *base_of(const error& e) { return nullptr; }
+inline const node_base *base_of(const numeric& n) { return nullptr; }
+inline const node_base *base_of(const expr& e) { return boost::apply_visitor([](const auto& x) { return base_of(x); }, e); }
+inline uint64_t degree_of(const expr& e) { auto node = base_of(e); return node ? node->degree : 0; }
+
+// Canonical key, computed when the nodes are built: degree in the canonical variables (descending, if by_degree),
+// type, then leading characters of the names, which order like the structural comparison. Only expressions with
+// equal keys are compared structurally.
+inline std::tuple<uint64_t, int, uint64_t> order_key(const expr& e, bool by_degree) {
+	auto node = base_of(e);
+	return std::make_tuple(by_degree && node ? ~node->degree : ~uint64_t(0), e.which(), node ? node->rank : 0);
+}
+}
+
+namespace detail {
+
+struct identical_nodes : public boost::static_visitor<bool>
+{
+	template <typename T, typename U> bool operator()(const T& lh, const U& rh) const { return false; }
+	template <typename T> bool operator()(const T& lh, const T& rh) const { return lh.id() == rh.id(); }
+	bool operator()(const error& lh, const error& rh) const { return lh.get() == rh.get(); }
+	bool operator()(const numeric& lh, const numeric& rh) const { return lh.value() == rh.value(); }
+};
+
+struct hash_num : public boost::static_visitor<size_t>
+{
+	template <typename T> size_t operator()(T value) const { return boost::hash_value(value); }
+	size_t operator()(rational_t value) const { size_t seed = value.numer(); boost::hash_combine(seed, value.denom()); return seed; }
+	size_t operator()(complex_t value) const { size_t seed = boost::hash_value(value.real()); boost::hash_combine(seed, value.imag()); return seed; }
+	size_t operator()(const bigint& value) const { return value.hash(); }
+	size_t operator()(const bigrat& value) const { return value.hash(); }
+	template <typename T> size_t operator()(const multiprecision<T>& value) const { return value.hash(); }
+	size_t operator()(const ball& value) const { return value.hash(); }
+	size_t operator()(const gaussian& value) const { return value.hash(); }
+};
+
+inline size_t hash_value(const error& e) { return (size_t)e.get(); }
+inline size_t hash_value(const numeric& n) { return boost::apply_visitor(hash_num(), n.value()); }
+template<class T> size_t hash_value(const shared_node<T>& n) { return n.node().hash; }
+inline size_t hash_of(const expr& e) { return boost::apply_visitor([](const auto& x) { return hash_value(x); }, e); }
+inline bool identical(const expr& lh, const expr& rh) { return boost::apply_visitor(identical_nodes(), lh, rh); }
+inline const void *node_id(const error& e) { return nullptr; }
+inline const void *node_id(const numeric& n) { return nullptr; }
+template<class T> const void *node_id(const shared_node<T>& n) { return n.id(); }
+inline const void *node_id(const expr& e) { return boost::apply_visitor([](const auto& x) { return node_id(x); }, e); }
+inline bool is_loose(const error& e) { return false; }
+inline bool is_loose(const numeric& n) { return false; }
+template<class T> bool is_loose(const shared_node<T>& n) { return n.node().loose; }
+inline bool is_loose(const expr& e) { return boost::apply_visitor([](const auto& x) { return is_loose(x); }, e); }
+inline const symbol_set& free_vars(const error& e) { static const symbol_set none; return none; }
+inline const symbol_set& free_vars(const numeric& n) { static const symbol_set none; return none; }
+template<class T> const symbol_set& free_vars(const shared_node<T>& n) { return n.node().vars; }
+inline const symbol_set& free_vars(const expr& e) { return boost::apply_visitor([](const auto& x) -> const symbol_set& { return free_vars(x); }, e); }
+inline bool exact_in(const error& e, const arena_pool *arena) { return true; }
+inline bool exact_in(const numeric& n, const arena_pool *arena) { return true; }
+template<class T> bool exact_in(const shared_node<T>& n, const arena_pool *arena) { return n.node().exact_in(arena); }
+// Children built without interning or in other arenas make the parent inexact, equal copies of them may exist under other parents
+inline void add_child(node_base& node, const expr& child) {
+	node.vars |= free_vars(child);
+	node.canonical = node.canonical && boost::apply_visitor([&node](const auto& x) { return exact_in(x, node.pool); }, child);
+}
+
+}
+
+namespace detail {
+
+// Copies of nodes in the current allocation scope, every shared node is copied once
+class promotion
+{
+	node_memo<expr>	_done;
+
+	list_t copy(const list_t& items) { list_t ret; ret.reserve(items.size()); for(auto& e : items)	ret.push_back(apply(e)); return ret; }
+	expr rebuild(const error& e)	{ return e; }
+	expr rebuild(const numeric& n)	{ return n; }
+	expr rebuild(const symbol& s)	{ return symbol{s.sid(), apply(s.value())}; }
+	expr rebuild(const power& p)	{ return power{apply(p.x()), apply(p.y())}; }
+	expr rebuild(const product& p)	{ return product(copy(p.items())); }
+	expr rebuild(const sum& s)		{ return sum(copy(s.items())); }
+	expr rebuild(const xset& s)		{ return xset(copy(s.items())); }
+	expr rebuild(const func& f)		{ return func{f.name(), apply(f.x()), f.impl()}; }
+
+public:
+	expr apply(const expr& e) { return _done(e, [this](const expr& e) { return boost::apply_visitor([this](const auto& x) { return rebuild(x); }, e); }); }
+};
+
+}
+
+// Rebuilds expression in the current allocation scope (on the heap, if no arena is active)
+inline expr promote(const expr& e) { return detail::promotion{}.apply(e); }
+
+inline expr error::subst(const pair<expr, expr>& s) const { return *this; };
+inline expr error::d(const expr& dx) const { return *this; };
+inline expr error::integrate(const expr& dx, const expr& c) const { return *this; };
 inline expr error::approx() const { return *this; };
 inline expr error::simplify() const { return *this; };
-inline bool error::match(expr e, match_result& res) const { if(e != expr{*this}) res.found = false; return res; };
+inline bool error::match(const expr& e, match_result& res) const { if(e != expr{*this}) res.found = false; return res; };
 inline unsigned error::exponents(const list_t& vars) const { return 0; }
 inline expr match_result::operator[] (symbol s) { auto it = std::find(matches.begin(), matches.end(), s); return it == matches.end() ? empty : it->value(); }
 
 const expr e = symbol{"#e", numeric{boost::math::constants::e<double>()}};
 const expr pi = symbol{"#p", numeric{boost::math::constants::pi<double>()}};
-const list_t variables = {symbol{"x"}, symbol{"y"}, symbol{"z"}};
 
 inline numeric operator "" _i(unsigned long long val)	{ return complex_t{ 0, (real_t)val }; }
 inline numeric operator "" _i(long double val)			{ return complex_t{ 0, (real_t)val }; }
@@ -377,3 +689,7 @@ inline expr operator "" _e(unsigned long long val)		{ return numeric{ (int_t)val
 inline expr operator "" _e(long double val)				{ return numeric{ (real_t)val }; }
 
 }
+
+namespace std {
+template<> struct hash<cas::expr> { size_t operator()(const cas::expr& e) const { return cas::detail::hash_of(e); } };
+}
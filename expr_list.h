@@ -1,67 +1,58 @@
 #pragma once
 
-#include <iterator>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
 
 namespace cas {
 struct match_result;
 namespace detail {
 
-template<class L> class expr_list_const_iterator : public std::iterator<std::forward_iterator_tag, typename L::value_type, ptrdiff_t, typename L::const_pointer, typename L::const_reference>
+// Node of the list: elements in sorted order, nested lists of the same type are flattened.
+// Elements are indexed by T::key, like terms have equal keys. Elements that can combine with unlike ones, functions
+// and their powers (sin²+cos², sin∙cos⁻¹) and sums, which products are distributed over, are indexed under any_key.
+template<class T, class Expr> struct list_node : node_base
 {
-protected:
-	const L*_plist;
-	bool	_atend;
-public:
-	typedef typename L::const_reference reference;
-	expr_list_const_iterator(const L *plist) : _plist(plist), _atend(false) {}
-	expr_list_const_iterator() : _plist(nullptr), _atend(true) {}
-	bool operator == (const expr_list_const_iterator& it) { return _atend == it._atend && _plist == it._plist; }
-	bool operator != (const expr_list_const_iterator& it) { return !(*this == it); }
-	reference operator *() const { return _atend ? _plist->_right : _plist->_left; }
-	const L* operator->() const { return _plist; }
-	expr_list_const_iterator& operator++() {
-		if(_plist == nullptr)	return *this;
-		else if(_plist->_right.type() == typeid(L::cont_type))	_plist = &boost::get<L::cont_type>(_plist->_right);
-		else if(!_atend)	_atend = true;
-		else				_plist = nullptr;
-		return *this;
+	enum : size_t { any_key = 0 };
+	std::vector<Expr> items;
+	std::vector<std::pair<size_t, uint32_t>> keys;	// (key, position) of every item in sorted order
+	list_node(std::vector<Expr> items) : node_base(hash_list(hash_of(T::unit()), items), std::any_of(items.begin(), items.end(), [](const Expr& e) { return is_loose(e); })), items(std::move(items)) {
+		keys.reserve(this->items.size());
+		for(uint32_t i = 0; i < this->items.size(); i++)	add_child(*this, this->items[i]), keys.emplace_back(index_key(this->items[i]), i);
+		std::sort(keys.begin(), keys.end());
+		degree = T::degree(this->items);
 	}
+	static bool combines_any(const Expr& e) { return is<func>(e) || is<power>(e) && is<func>(as<power>(e).x()) || is<sum>(e); }
+	static size_t index_key(const Expr& e) { return combines_any(e) ? any_key : T::key(e); }
 };
 
-template<class L> class expr_list_iterator : public std::iterator<std::forward_iterator_tag, typename L::value_type>
-{
-protected:
-	L*		_plist;
-	L*		_pprev;
-	bool	_atend;
-public:
-	typedef typename L::value_type value_type;
-	typedef typename L::reference reference;
-	expr_list_iterator(L *plist) : _plist(plist), _pprev(nullptr), _atend(false) {}
-	expr_list_iterator() : _plist(nullptr), _pprev(nullptr), _atend(true) {}
-	bool at_last() const { return _atend; }
-	L* prev() const { return _pprev; }
-	bool operator == (const expr_list_iterator& it) { return _atend == it._atend && _plist == it._plist; }
-	bool operator != (const expr_list_iterator& it) { return !(*this == it); }
-	reference operator *() const { return _atend ? _plist->_right : _plist->_left; }
-	L* operator->() const { return _plist; }
-	expr_list_iterator& operator++() {
-		if(_plist == nullptr)	return *this;
-		else if(_plist->_right.type() == typeid(L::cont_type))	_pprev = _plist, _plist = &boost::get<L::cont_type>(_plist->_right);
-		else if(!_atend)	_atend = true;
-		else				_plist = nullptr;
-		return *this;
-	}
-};
+template<class T, class Expr> bool identical(const list_node<T, Expr>& lh, const list_node<T, Expr>& rh) {
+	return std::equal(lh.items.begin(), lh.items.end(), rh.items.begin(), rh.items.end(), [](const Expr& l, const Expr& r) { return identical(l, r); });
+}
 
 template<class T, class Expr, class Pred = std::less<Expr>>
-class expr_list
+class expr_list : public shared_node<list_node<T, Expr>>
 {
 protected:
 	Pred _comp;
-	Expr _left;
-	Expr _right;
-	void set(Expr& to, Expr& from) { Expr tmp = from; to = tmp; }
+
+	static void flatten(std::vector<Expr>& items, Expr e) {
+		if(is<T>(e))	items.insert(items.end(), as<T>(e).begin(), as<T>(e).end());
+		else			items.push_back(std::move(e));
+	}
+	static std::vector<Expr> flatten(Expr left, Expr right) {
+		std::vector<Expr> items;
+		flatten(items, std::move(left));
+		flatten(items, std::move(right));
+		return items;
+	}
+	// list of the given elements, single element or unit if there are less than two of them
+	static Expr make_list(std::vector<Expr> items) {
+		if(items.empty())		return T::unit();
+		if(items.size() == 1)	return items.front();
+		return T{std::move(items)};
+	}
+	void assign(std::vector<Expr> items) { static_cast<T&>(*this) = T{std::move(items)}; }
 
 public:
 	typedef Expr value_type;
@@ -71,74 +62,93 @@ public:
 	typedef Expr& reference;
 	typedef const Expr* const_pointer;
 	typedef const Expr& const_reference;
-	typedef expr_list_iterator<expr_list<T, Expr, Pred>> iterator;
-	typedef expr_list_const_iterator<expr_list<T, Expr, Pred>> const_iterator;
-	friend class iterator;
-	friend class const_iterator;
-
-	expr_list(const Expr& left, const Expr& right) : _left(left), _right(right), _comp(Pred()) {}
-	expr_list(Expr&& left, Expr&& right) : _left(left), _right(right), _comp(Pred()) {}
-	Expr left() const { return _left; }
-	Expr right() const { return _right; }
-
-	iterator begin() { return iterator(this); }
-	iterator end() { return iterator(); }
-	const_iterator begin() const { return const_iterator(this); }
-	const_iterator end() const { return const_iterator(); }
-
-	void erase(iterator it)
-	{
-		expr tmp;
-		if(it.at_last()) {
-			if(it.prev())	set(it.prev()->_right, it->_left);
-			else			_right = it->_left, _left = T::unit();
-		} else {
-			if(it.prev())	set(it.prev()->_right, it->_right);
-			else if((++it).at_last())	_left = T::unit();
-			else 			_left = it->_left, set(_right, it->_right);
-		}
+	typedef typename std::vector<Expr>::const_iterator iterator;
+	typedef typename std::vector<Expr>::const_iterator const_iterator;
+
+	expr_list(Expr left, Expr right) : shared_node<list_node<T, Expr>>(flatten(std::move(left), std::move(right))), _comp(Pred()) {}
+	explicit expr_list(std::vector<Expr> items) : shared_node<list_node<T, Expr>>(std::move(items)), _comp(Pred()) {}
+	const std::vector<Expr>& items() const { return this->node().items; }
+	size_t size() const { return items().size(); }
+	// first element and the list of the remaining ones
+	const Expr& left() const { return items().front(); }
+	Expr right() const { return make_list(std::vector<Expr>(items().begin() + 1, items().end())); }
+
+	const_iterator begin() const { return items().begin(); }
+	const_iterator end() const { return items().end(); }
+
+	// applies f to every element and builds new list of the results
+	template<class F> Expr combine(F f) const {
+		std::vector<Expr> res;
+		res.reserve(size());
+		for(const auto& e : items())	res.push_back(f(e));
+		return T::make(std::move(res));
 	}
 
-	iterator insert(iterator it, const Expr& e)
+	// order of nested lists: the rests of the lists are compared first, then the first elements
+	bool less(const T& rh) const {
+		const auto& l = items(), &r = rh.items();
+		if(l.size() != r.size())	return l.size() < r.size() ? l.back().which() < Expr{rh}.which() : Expr{rh}.which() < r.back().which();
+		for(auto i = l.size(); i-- > 0; )	if(!(l[i] == r[i]))	return l[i] < r[i];
+		return false;
+	}
+
+	void erase(const_iterator it)
 	{
-		insert(e);
-		return it;
+		std::vector<Expr> rest(begin(), end());
+		rest.erase(rest.begin() + (it - begin()));
+		if(rest.size() == 1)	rest.insert(rest.begin(), T::unit());
+		assign(std::move(rest));
 	}
 
 	void insert(const Expr& e)
 	{
-		if(_right == T::unit())		_right = e;
-		else if(_left == T::unit()) { _left = e; if(!_comp(_left, _right)) swap(_left, _right); }
-		else if(_comp(e, _left))	_right = T{_left, _right}, _left = e;
-		else if(_right.type() == typeid(T))	boost::get<T>(_right).insert(e);
-		else if(_comp(e, _right))	_right = T{e, _right};
-		else						_right = T{_right, e};
+		if(size() == 2 && left() == T::unit()) {
+			std::vector<Expr> rest{items().back()};
+			rest.insert(std::upper_bound(rest.begin(), rest.end(), e, _comp), e);
+			return assign(std::move(rest));
+		}
+		auto pos = std::upper_bound(begin(), end(), e, _comp);
+		std::vector<Expr> items;
+		items.reserve(size() + 1);
+		items.insert(items.end(), begin(), pos);
+		items.push_back(e);
+		items.insert(items.end(), pos, end());
+		assign(std::move(items));
 	}
 
 	// try to append new element (summand or multiplicand) to the list
 	// returns unappendable remainder and modified list
+	// Only the like terms of e found by binary search in the key index and the items that combine with
+	// anything are tried, in the order of the list
 	std::pair<Expr, Expr> try_append(const Expr& e) const
 	{
-		auto&& t = T::op(_left, e);
-		if(t.type() != typeid(T)) {
-			auto&& u = T::op(_right, t);
-			if(u.type() != typeid(T))	return{T::unit(), u};
-			else						return{t, _right};
-		}
-
-		if(is<T>(_right)) {
-			auto& r = as<T>(_right).try_append(e);
-			return{r.first, T{_left, r.second}};
+		auto& keys = this->node().keys;
+		std::vector<uint32_t> found;
+		for(auto key : {T::key(e), size_t(list_node<T, Expr>::any_key)})
+			for(auto k = std::lower_bound(keys.begin(), keys.end(), std::make_pair(key, uint32_t(0))); k != keys.end() && k->first == key; ++k)	found.push_back(k->second);
+		std::sort(found.begin(), found.end());
+		found.erase(std::unique(found.begin(), found.end()), found.end());
+		for(auto i : found) {
+			auto it = begin() + i;
+			auto&& t = T::op(*it, e);
+			if(t.type() == typeid(T))	continue;
+			std::vector<Expr> items;
+			items.reserve(size() - 1);
+			items.insert(items.end(), begin(), it);
+			items.insert(items.end(), it + 1, end());
+			auto rest = make_list(std::move(items));
+			if(it == begin()) {
+				auto&& u = T::op(rest, t);
+				if(u.type() != typeid(T))	return{T::unit(), u};
+			}
+			return{t, rest};
 		}
-
-		t = T::op(_right, e);
-		if(t.type() != typeid(T)) return{t, _left};
 		return{e, static_cast<const T&>(*this)};
 	}
 
 	Expr append(const Expr& e) const
 	{
-		auto& r = try_append(e);
+		auto r = try_append(e);
 		if(r.first == T::unit())	return r.second;
 
 		if(is<T>(r.second)) {
@@ -150,7 +160,7 @@ public:
 		}
 	}
 
-	bool match(Expr e, match_result& res) const {
+	bool match(const Expr& e, match_result& res) const {
 		const T& pp = static_cast<const T&>(*this);
 		if(!is<T>(e)) return cas::match(T{T::unit(), e}, pp, res);
 		const T& pe = as<T>(e);
@@ -158,10 +168,10 @@ public:
 			for(auto e_it = pe.begin(); e_it != pe.end(); ++e_it) {
 				match_result mr = res;
 				if(cas::match(*e_it, *p_it, mr)) {
-					T p_rest{T::unit(),T::unit()}, e_rest{T::unit(),T::unit()};
-					copy_if(pp.begin(), pp.end(), std::inserter(p_rest, p_rest.end()), [p_it](auto e) {return e != *p_it; });
-					copy_if(pe.begin(), pe.end(), std::inserter(e_rest, e_rest.end()), [e_it](auto e) {return e != *e_it; });
-					if(cas::match(e_rest.left() == T::unit() ? e_rest.right() : e_rest, p_rest.left() == T::unit() ? p_rest.right() : p_rest, mr))	return res = mr;
+					std::vector<Expr> p_rest, e_rest;
+					copy_if(pp.begin(), pp.end(), back_inserter(p_rest), [p_it](const Expr& e) {return e != *p_it; });
+					copy_if(pe.begin(), pe.end(), back_inserter(e_rest), [e_it](const Expr& e) {return e != *e_it; });
+					if(cas::match(make_list(std::move(e_rest)), make_list(std::move(p_rest)), mr))	return res = mr;
 				}
 			}
 		}
@@ -169,4 +179,4 @@ public:
 	};
 };
 }
-}
\ No newline at end of file
+}
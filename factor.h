@@ -0,0 +1,166 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "bigint.h"
+
+namespace cas {
+
+template<class T> T gcd(T a, T b) { while(b) a %= b, std::swap(a, b); return a < 0 ? -a : a; }
+
+namespace detail {
+
+typedef std::vector<std::pair<uint32_t, unsigned>> factors_t;		// prime and its exponent, ascending primes
+
+inline uint32_t mulmod(uint64_t a, uint64_t b, uint32_t m) { return (uint32_t)(a * b % m); }
+inline uint32_t powmod(uint64_t x, uint32_t e, uint32_t m) {
+	uint64_t r = 1;
+	for(x %= m; e; e /= 2, x = x * x % m)	if(e % 2)	r = r * x % m;
+	return (uint32_t)r;
+}
+inline uint64_t ipow(uint64_t x, unsigned e) { uint64_t r = 1; for(; e; e /= 2, x *= x)	if(e % 2)	r *= x; return r; }
+
+// ⌊ⁿ√x⌋ by Newton's iteration y ← ((k-1)y + x/yᵏ⁻¹)/k, it decreases monotonically from a power of two above the root
+inline uint32_t iroot(uint32_t x, unsigned k) {
+	if(k == 1 || x < 2)	return x;
+	if(k >= 32)			return 1;
+	unsigned bits = 0;
+	while(bits < 32 && x >> bits)	bits++;
+	uint64_t y = 1ull << (bits + k - 1) / k;
+	for(;;) {
+		uint64_t z = ((k - 1) * y + x / ipow(y, k - 1)) / k;
+		if(z >= y)	return (uint32_t)y;
+		y = z;
+	}
+}
+inline bigint iroot(const bigint& x, unsigned k) {			// x ≥ 0
+	if(k == 1 || x < bigint{2})	return x;
+	size_t bits = x.limbs().size() * 32;
+	if(k >= bits)	return bigint{1};
+	bigint y = bigint{2}.pow((unsigned)((bits + k - 1) / k)), k1{k - 1ll}, kk{(long long)k};
+	for(;;) {
+		bigint z = (k1 * y + x / y.pow(k - 1)) / kk;
+		if(!(z < y))	return y;
+		y = std::move(z);
+	}
+}
+// x = rootᵏ
+template<class T> bool is_power(const T& x, unsigned k, T& root) { root = iroot(x, k); return root.pow(k) == x; }
+inline bool is_power(uint32_t x, unsigned k, uint32_t& root) { root = iroot(x, k); return ipow(root, k) == x; }
+
+// Deterministic Miller-Rabin: bases 2, 7 and 61 decide all numbers below 4759123141
+inline bool is_prime(uint32_t n) {
+	if(n < 2)	return false;
+	for(uint32_t p : {2u, 3u, 5u, 7u, 11u, 13u, 61u})	if(n % p == 0)	return n == p;
+	uint32_t d = n - 1, s = 0;
+	while(d % 2 == 0)	d /= 2, s++;
+	for(uint32_t a : {2u, 7u, 61u}) {
+		uint32_t x = powmod(a, d, n);
+		if(x == 1 || x == n - 1)	continue;
+		uint32_t i = 1;
+		for(; i < s && x != n - 1; i++)	x = mulmod(x, x, n);
+		if(x != n - 1)	return false;
+	}
+	return true;
+}
+
+// Nontrivial factor of an odd composite number: Pollard's rho with Brent's cycle detection,
+// differences are multiplied in batches of m so one gcd is taken per batch
+inline uint32_t pollard_brent(uint32_t n) {
+	const uint64_t m = 64;
+	for(uint32_t c = 1; ; c++) {
+		auto f = [n, c](uint64_t x) { return (x * x + c) % n; };
+		uint64_t x = 0, y = 2, ys = y, q = 1, g = 1;
+		for(uint64_t r = 1; g == 1; r *= 2) {
+			x = y;
+			for(uint64_t i = 0; i < r; i++)	y = f(y);
+			for(uint64_t k = 0; k < r && g == 1; k += m) {
+				ys = y;
+				for(uint64_t i = 0; i < std::min(m, r - k); i++)	y = f(y), q = q * (x > y ? x - y : y - x) % n;
+				g = gcd<uint64_t>(q, n);
+			}
+		}
+		if(g == n)	do ys = f(ys), g = gcd<uint64_t>(x > ys ? x - ys : ys - x, n); while(g == 1);
+		if(g != n)	return (uint32_t)g;
+	}
+}
+
+inline const std::vector<uint32_t>& small_primes() {
+	static const std::vector<uint32_t> primes = [] {
+		const uint32_t limit = 1024;
+		std::vector<bool> composite(limit);
+		std::vector<uint32_t> primes;
+		for(uint32_t p = 2; p < limit; p++) {
+			if(composite[p])	continue;
+			primes.push_back(p);
+			for(uint32_t q = p * p; q < limit; q += p)	composite[q] = true;
+		}
+		return primes;
+	}();
+	return primes;
+}
+
+// Recently factorized numbers, least recently used ones are evicted first
+class factor_cache
+{
+	typedef std::list<std::pair<uint32_t, factors_t>>::iterator iterator;
+	std::list<std::pair<uint32_t, factors_t>>	_entries;
+	std::unordered_map<uint32_t, iterator>		_index;
+	size_t	_capacity;
+public:
+	explicit factor_cache(size_t capacity) : _capacity(capacity) {}
+	bool find(uint32_t n, factors_t& factors) {
+		auto it = _index.find(n);
+		if(it == _index.end())	return false;
+		_entries.splice(_entries.begin(), _entries, it->second);
+		return factors = it->second->second, true;
+	}
+	void insert(uint32_t n, const factors_t& factors) {
+		if(!_capacity)	return;
+		if(_entries.size() >= _capacity)	_index.erase(_entries.back().first), _entries.pop_back();
+		_entries.emplace_front(n, factors);
+		_index[n] = _entries.begin();
+	}
+};
+
+inline void split(uint32_t n, std::vector<uint32_t>& primes) {
+	if(n == 1)	return;
+	if(is_prime(n))	{ primes.push_back(n); return; }
+	uint32_t root;
+	for(unsigned k = 2; k <= 3; k++)								// rho is slow for powers of a prime
+		if(is_power(n, k, root)) {
+			for(unsigned i = 0; i < k; i++)	split(root, primes);
+			return;
+		}
+	auto d = pollard_brent(n);
+	split(d, primes), split(n / d, primes);
+}
+
+// Prime factors of n > 0: trial division by the primes below 1024, then Miller-Rabin and Pollard-Brent
+inline factors_t factorize(uint32_t n) {
+	static factor_cache cache(256);
+	factors_t factors;
+	if(cache.find(n, factors))	return factors;
+	uint32_t m = n;
+	for(auto p : small_primes()) {
+		if((uint64_t)p * p > m)	break;
+		unsigned e = 0;
+		while(m % p == 0)	m /= p, e++;
+		if(e)	factors.emplace_back(p, e);
+	}
+	std::vector<uint32_t> primes;
+	split(m, primes);
+	std::sort(primes.begin(), primes.end());
+	for(auto p : primes)
+		if(!factors.empty() && factors.back().first == p)	factors.back().second++;
+		else												factors.emplace_back(p, 1);
+	cache.insert(n, factors);
+	return factors;
+}
+
+}
+}
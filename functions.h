@@ -21,31 +21,56 @@ expr arctg(expr x);
 inline expr fn(string name, expr args)			  { return func{name, args}; }
 inline expr fn(string name, expr args, expr body) { return func{name, args, body}; }
 
-inline func::func(string name, expr args) : _name(name), _args(args), _impl{
-	[name, args](expr x)	{ return same_size(x, args) ? func{name, x} : make_err(error_t::invalid_args); },
-	[args](expr f, expr dx) {
+// Descriptor of functions without definition, shared by all of them
+inline const std::shared_ptr<const func::callbacks>& undefined_fun() {
+	static const auto impl = std::make_shared<const func::callbacks>(
+	[](expr f, expr x)		{ return same_size(x, as<func>(f).x()) ? func{as<func>(f).name(), x} : make_err(error_t::invalid_args); },
+	[](expr f, expr dx) {
+		auto& args = as<func>(f).x();
 		if(is<xset>(args))	{
 			auto& a = as<xset>(args).items();
-			auto it = std::find_if(a.begin(), a.end(), [dx](auto x) {return df(x, dx) != zero; });
+			auto it = std::find_if(a.begin(), a.end(), [&dx](const expr& x) {return depends_on(x, dx); });
 			return it == a.end() ? zero : df(*it, dx) * make_dif(f, dx);
 		}	else return df(args, dx) * make_dif(f, dx);
 	},
-	[](expr f, expr dx) { return df(f, dx) == zero ? f * dx : make_int(f, dx); }
-} {}
+	[](expr f, expr dx) { return !depends_on(f, dx) ? f * dx : make_int(f, dx); });
+	return impl;
+}
+
+namespace detail {
+inline std::shared_ptr<const func::callbacks> builtin_fun(const string& name) { auto impl = func::find(name); return impl ? impl : undefined_fun(); }
+}
 
-inline func::func(string name, expr args, expr body) : _name(name), _args(args), _impl{
-	[body, args](expr x)	{ return same_size(x, args) ? ::subst(body, args, x) : make_err(error_t::invalid_args); },
+// Functions get the descriptor of the built-in function of their name, if there is one
+inline func::func(string name, expr args) : func(name, std::move(args), detail::builtin_fun(name)) {}
+
+inline func::func(string name, expr args, expr body) : func(name, args, callbacks{
+	[body, args](expr f, expr x)	{ return same_size(x, args) ? ::subst(body, args, x) : make_err(error_t::invalid_args); },
 	[body](expr f, expr dx) { return df(body, dx);   },
-	[body](expr f, expr dx) { return intf(body, dx); }
-} {}
+	[body](expr f, expr dx) { return intf(body, dx); },
+	approx_fun,
+	print_fun,
+	detail::free_vars(body)
+}) {}
 
 inline expr approx_fun(expr f, expr x) { return as<func>(f)(x); }
-inline auto apply_fun(real_t rfun(real_t x), complex_t cfun(const complex_t& x)) {
+// Numeric values of a function: fun is called with real_t, complex_t, their multiprecision counterparts or balls.
+// While approx has a precision, integers are converted to multiprecision numbers or balls.
+template<class F> auto apply_fun(F fun) {
 	return [=](expr f, expr x) {
 		if(is<xset>(x))	x = as<xset>(x).items().size() == 1 ? as<xset>(x).items()[0] : make_err(error_t::syntax);
-		if(is<numeric, int_t>(x))		return make_num(rfun((real_t)as<numeric, int_t>(x)));
-		if(is<numeric, real_t>(x))		return make_num(rfun(as<numeric, real_t>(x)));
-		if(is<numeric, complex_t>(x))	return make_num(cfun(as<numeric, complex_t>(x)));
+		if(is<numeric, ball>(x))		return make_num(fun(as<numeric, ball>(x)));
+		if(is<numeric, mpreal>(x))		return detail::make_mp(fun(as<numeric, mpreal>(x).value()), as<numeric, mpreal>(x).digits());
+		if(is<numeric, mpcomplex>(x))	return detail::make_mp(fun(as<numeric, mpcomplex>(x).value()), as<numeric, mpcomplex>(x).digits());
+		if(auto digits = detail::current_digits()) {
+			auto num = [&fun, digits](const auto& v) { return detail::enclosing() ? make_num(fun(detail::enclose(v, digits))) : detail::make_mp(fun(detail::multi(v)), digits); };
+			if(is<numeric, int_t>(x))	return num(as<numeric, int_t>(x));
+			if(is<numeric, bigint>(x))	return num(as<numeric, bigint>(x));
+		}
+		if(is<numeric, int_t>(x))		return make_num(fun((real_t)as<numeric, int_t>(x)));
+		if(is<numeric, real_t>(x))		return make_num(fun(as<numeric, real_t>(x)));
+		if(is<numeric, bigint>(x))		return make_num(fun((real_t)as<numeric, bigint>(x)));
+		if(is<numeric, complex_t>(x))	return make_num(fun(as<numeric, complex_t>(x)));
 		return as<func>(f)(x);
 	};
 }
@@ -58,12 +83,13 @@ inline expr ln(expr x)
 	if(x == inf)		return inf;																	// ln(∞) ⇒ ∞
 	if(is<product>(x))	return ln(as<product>(x).left()) + ln(as<product>(x).right());				// ln(x∙y) ⇒ ln(x)+ln(y)
 	if(is<power>(x))	return as<power>(x).y() * ln(as<power>(x).x());								// ln(xʸ) ⇒ y∙ln(x)
-	return func{S_LN, x, {
+	static const auto impl = func::define(S_LN, {
 		ln,
-		[x](expr f, expr dx) { return df(x, dx) / x; },												// ln(f)' ⇒ f'/x
-		[x](expr f, expr dx) { auto a = df(x, dx); return a != zero && (df(a, dx) == zero) ? x / a * ln(x) - dx : make_int(f, dx); },
-		apply_fun(std::log, std::log)
-	}};
+		[](expr f, expr dx) { auto& x = as<func>(f).x(); return df(x, dx) / x; },					// ln(f)' ⇒ f'/x
+		[](expr f, expr dx) { auto& x = as<func>(f).x(); auto a = df(x, dx); return a != zero && !depends_on(a, dx) ? x / a * ln(x) - dx : make_int(f, dx); },
+		apply_fun([](const auto& x) { using std::log; return log(x); })
+	});
+	return func{S_LN, x, impl};
 }
 
 inline expr sin(expr x)
@@ -79,12 +105,13 @@ inline expr sin(expr x)
 	if(x == 2*pi/2)					return minus_one;												// sin(3π/2) ⇒ -1
 	if(is<product>(x) && has_sign(as<product>(x).left())) return -sin(-x);							// sin(-x) ⇒ -sin(x)
 	if(is<func>(x) && as<func>(x).name() == S_ASIN)	return as<func>(x).x();							// sin(arcsin(x)) ⇒ x
-	return func{S_SIN, x, {
+	static const auto impl = func::define(S_SIN, {
 		sin, 
-		[x](expr f, expr dx) { return df(x, dx) * cos(x); },										// sin(f)' ⇒ f'∙cos(x)
-		[x](expr f, expr dx) { return df(x, dx) == zero ? x * dx : x == dx ? -cos(x) : make_int(f, dx); },
-		apply_fun(std::sin, std::sin)
-	}};
+		[](expr f, expr dx) { auto& x = as<func>(f).x(); return df(x, dx) * cos(x); },			// sin(f)' ⇒ f'∙cos(x)
+		[](expr f, expr dx) { auto& x = as<func>(f).x(); return !depends_on(x, dx) ? x * dx : x == dx ? -cos(x) : make_int(f, dx); },
+		apply_fun([](const auto& x) { using std::sin; return sin(x); })
+	});
+	return func{S_SIN, x, impl};
 }
 
 inline expr cos(expr x)
@@ -100,47 +127,52 @@ inline expr cos(expr x)
 	if(x == pi)						return minus_one;												// cos(π) ⇒ -1
 	if(is<product>(x) && has_sign(as<product>(x).left())) return cos(-x);							// cos(-x) ⇒ cos(x)
 	if(is<func>(x) && as<func>(x).name() == S_ACOS)	return as<func>(x).x();							// cos(arccos(x)) ⇒ x
-	return func{S_COS, x, {
+	static const auto impl = func::define(S_COS, {
 		cos,
-		[x](expr f, expr dx) { return df(x, dx) * -sin(x); },										// cos(f)' ⇒ -f'∙sin(x)
-		[x](expr f, expr dx) { return df(x, dx) == zero ? x * dx : x == dx ? sin(x) : make_int(f, dx); },
-		apply_fun(std::cos, std::cos)
-	}};
+		[](expr f, expr dx) { auto& x = as<func>(f).x(); return df(x, dx) * -sin(x); },			// cos(f)' ⇒ -f'∙sin(x)
+		[](expr f, expr dx) { auto& x = as<func>(f).x(); return !depends_on(x, dx) ? x * dx : x == dx ? sin(x) : make_int(f, dx); },
+		apply_fun([](const auto& x) { using std::cos; return cos(x); })
+	});
+	return func{S_COS, x, impl};
 }
 
 inline expr tg(expr x) {
 	if(is<product>(x) && has_sign(as<product>(x).left())) return -tg(-x);							// tg(-x) ⇒ -tg(x)
 	if(is<func>(x) && as<func>(x).name() == S_ATG)		return as<func>(x).x();						// tg(arctg(x)) ⇒ x
-	return func{S_TG, x, {
+	static const auto impl = func::define(S_TG, {
 		tg,
-		[x](expr f, expr dx) { return df(x, dx) / (cos(x) ^ two); },								// tg(f)' ⇒ f'/cos²(x)
-		[x](expr f, expr dx) { return df(x, dx) == zero ? x * dx : x == dx ? -ln(cos(x)) : make_int(f, dx); },
-		apply_fun(std::tan, std::tan)
-	}};
+		[](expr f, expr dx) { auto& x = as<func>(f).x(); return df(x, dx) / (cos(x) ^ two); },	// tg(f)' ⇒ f'/cos²(x)
+		[](expr f, expr dx) { auto& x = as<func>(f).x(); return !depends_on(x, dx) ? x * dx : x == dx ? -ln(cos(x)) : make_int(f, dx); },
+		apply_fun([](const auto& x) { using std::tan; return tan(x); })
+	});
+	return func{S_TG, x, impl};
 }
 inline expr arcsin(expr x)	{
-	return func{S_ASIN, x, {
+	static const auto impl = func::define(S_ASIN, {
 		arcsin,
-		[x](expr f, expr dx) { return df(x, dx) / ((1 - (x^2)) ^ half); },							// arcsin(f)' ⇒ f'/√(1-x²)
-		[x](expr f, expr dx) { return df(x, dx) == zero ? x * dx : x == dx ? x * f + ((1-(x^2))^half) : make_int(f, dx); },
-		apply_fun(std::asin, std::asin)
-	}};
+		[](expr f, expr dx) { auto& x = as<func>(f).x(); return df(x, dx) / ((1 - (x^2)) ^ half); },	// arcsin(f)' ⇒ f'/√(1-x²)
+		[](expr f, expr dx) { auto& x = as<func>(f).x(); return !depends_on(x, dx) ? x * dx : x == dx ? x * f + ((1-(x^2))^half) : make_int(f, dx); },
+		apply_fun([](const auto& x) { using std::asin; return asin(x); })
+	});
+	return func{S_ASIN, x, impl};
 }
 inline expr arccos(expr x)	{
-	return func{S_ACOS, x, {
+	static const auto impl = func::define(S_ACOS, {
 		arccos,
-		[x](expr f, expr dx) { return -df(x, dx) / ((1 - (x^2)) ^ half); },							// arccos(f)' ⇒ -f'/√(1-x²)
-		[x](expr f, expr dx) { return df(x, dx) == zero ? x * dx : x == dx ? x * f - ((1-(x^2))^half) : make_int(f, dx); },
-		apply_fun(std::acos, std::acos)
-	}};
+		[](expr f, expr dx) { auto& x = as<func>(f).x(); return -df(x, dx) / ((1 - (x^2)) ^ half); },	// arccos(f)' ⇒ -f'/√(1-x²)
+		[](expr f, expr dx) { auto& x = as<func>(f).x(); return !depends_on(x, dx) ? x * dx : x == dx ? x * f - ((1-(x^2))^half) : make_int(f, dx); },
+		apply_fun([](const auto& x) { using std::acos; return acos(x); })
+	});
+	return func{S_ACOS, x, impl};
 }
 inline expr arctg(expr x)	{
-	return func{S_ATG, x, {
+	static const auto impl = func::define(S_ATG, {
 		arctg,
-		[x](expr f, expr dx) { return df(x, dx) / ((1 + (x^2)) ^ half); },							// arctg(f)' ⇒ f'/√(1+x²)
-		[x](expr f, expr dx) { return df(x, dx) == zero ? x * dx : x == dx ? x * f - half * ln(1+(x^2)) : make_int(f, dx); },
-		apply_fun(std::atan, std::atan)
-	}};
+		[](expr f, expr dx) { auto& x = as<func>(f).x(); return df(x, dx) / ((1 + (x^2)) ^ half); },	// arctg(f)' ⇒ f'/√(1+x²)
+		[](expr f, expr dx) { auto& x = as<func>(f).x(); return !depends_on(x, dx) ? x * dx : x == dx ? x * f - half * ln(1+(x^2)) : make_int(f, dx); },
+		apply_fun([](const auto& x) { using std::atan; return atan(x); })
+	});
+	return func{S_ATG, x, impl};
 }
 
 inline expr fdif(expr x)
@@ -165,10 +197,10 @@ inline expr fint(expr x)
 static expr fass(expr x) {
 	if(!is<xset>(x) || as<xset>(x).items().size() != 2)	return make_err(error_t::invalid_args);
 	auto& params = as<xset>(x).items();
-	if(is<symbol>(params[0]))			return symbol{as<symbol>(params[0]).name(), params[1]};
+	if(is<symbol>(params[0]))			return symbol{as<symbol>(params[0]).sid(), params[1]};
 	if(is<func>(params[0])) {
 		auto f = as<func>(params[0]);
-		return symbol{f.name(), func{f.name(), f.x(), params[1]}};
+		return symbol{f.name(), func{f.name(), f.x(), params[1]}};	// the script keeps the definition in its context
 	}
 	return make_err(error_t::syntax);
 };
@@ -181,54 +213,49 @@ static expr fsub(expr x) {
 };
 
 inline expr make_dif(expr f, expr dx) {
-	return func{S_DIF, xset{f, dx}, {
+	static const auto impl = func::define(S_DIF, {
 		fdif,
 		make_dif,
-		[f, dx](expr f2, expr dx2) { return dx2 == dx ? f : make_int(f2, dx2); },
+		[](expr f, expr dx) { auto& a = as<xset>(as<func>(f).x()).items(); return dx == a[1] ? a[0] : make_int(f, dx); },
 		approx_fun,
 		print_dif
-	}};
+	});
+	return func{S_DIF, xset{f, dx}, impl};
 }
 inline expr make_int(expr f, expr dx) { 
-	return func{S_INT, xset{f, dx},{
+	static const auto impl = func::define(S_INT, {
 		fint,
-		[f, dx](expr f2, expr dx2) { return dx2 == dx ? f : make_dif(f2, dx2); },
+		[](expr f, expr dx) { auto& a = as<xset>(as<func>(f).x()).items(); return dx == a[1] ? a[0] : make_dif(f, dx); },
 		make_int,
 		approx_fun,
 		print_int
-	}};
-}
-inline expr make_intd(expr f, expr dx, expr a, expr b) { return func{S_INT, xset{f, dx, a, b}, { fint, make_dif, make_int, approx_fun, print_int }}; }
-inline expr make_assign(expr x, expr y) { return func{S_ASSIGN, xset{x, y}, { fass, make_dif, make_int, approx_fun, print_assign }}; }
-inline expr make_subst(expr x, expr y)  { return func{S_SUBST,  xset{x, y}, { fsub, make_dif, make_int, approx_fun, print_subst }}; }
-
-inline list_t func::args() const { return is<xset>(_args) ? as<xset>(_args).items() : list_t{_args}; }
-inline expr func::d(expr dx) const { return _impl.d(*this, dx); }
-inline expr func::integrate(expr dx, expr c) const { return _impl.integrate(*this, dx) + c; }
-inline expr func::subst(pair<expr, expr> s) const { 
-	if(is<symbol>(s.first) && is<func>(s.second)) {
-		auto& f = as<func>(s.second);
-		if(as<symbol>(s.first).name() == name() && f.name() == name() && f.args().size() == args().size())	return f(_args);
-	}
-	return expr{*this} == s.first ? s.second : _impl.make(_args | s);
+	});
+	return func{S_INT, xset{f, dx}, impl};
 }
-inline expr func::approx() const { return _impl.approx(*this, ~_args); }
-inline expr func::simplify() const { return _impl.make(*_args); }
-inline ostream& func::print(ostream& os) const { return _impl.print(os, *this); }
+inline expr make_intd(expr f, expr dx, expr a, expr b) { static const auto impl = std::make_shared<const func::callbacks>(fint, make_dif, make_int, approx_fun, print_int); return func{S_INT, xset{f, dx, a, b}, impl}; }
+inline expr make_assign(expr x, expr y) { static const auto impl = func::define(S_ASSIGN, { fass, make_dif, make_int, approx_fun, print_assign }); return func{S_ASSIGN, xset{x, y}, impl}; }
+inline expr make_subst(expr x, expr y)  { static const auto impl = func::define(S_SUBST, { fsub, make_dif, make_int, approx_fun, print_subst }); return func{S_SUBST,  xset{x, y}, impl}; }
+
+inline list_t func::args() const { return is<xset>(x()) ? as<xset>(x()).items() : list_t{x()}; }
+inline expr func::d(const expr& dx) const { return impl()->d(*this, dx); }
+inline expr func::integrate(const expr& dx, const expr& c) const { return impl()->integrate(*this, dx) + c; }
+inline expr func::approx() const { return impl()->approx(*this, ~x()); }
+inline expr func::simplify() const { return impl()->make(*this, *x()); }
+inline ostream& func::print(ostream& os) const { return impl()->print(os, *this); }
 inline unsigned func::exponents(const list_t& vars) const { return 0; }
-inline bool func::match(expr e, match_result& res) const {	
+inline bool func::match(const expr& e, match_result& res) const {	
 	if(!is<func>(e)) return res.found = false;
 	auto f = as<func>(e);
-	return _name == f.name() ? cas::match(f.x(), _args, res) : res.found = false;
+	return name() == f.name() ? cas::match(f.x(), x(), res) : res.found = false;
 }
-inline expr func::operator()(expr values) const { return _impl.make(values); }
+inline expr func::operator()(expr values) const { return impl()->make(*this, values); }
 template <typename ... Params> expr func::operator ()(expr val, Params ... rest) const
 {
 	list_t rest_args = args();
 	if(rest_args.empty())	return error{error_t::invalid_args};
 	expr arg = rest_args.front();
 	rest_args.erase(rest_args.begin());
-	return func{_name, rest_args.size() == 1 ? rest_args.front() : rest_args, _impl.make(::subst(_args, arg, val)) }(rest...);
+	return func{name(), rest_args.size() == 1 ? rest_args.front() : rest_args, impl()->make(*this, ::subst(x(), arg, val)) }(rest...);
 }
 
 }
\ No newline at end of file
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "arena.h"
+#include "budget.h"
+
+namespace cas {
+namespace detail {
+
+// Expressions are single-threaded: the intern, symbol and function tables and the active arena, budget and memo
+// scopes are process-wide and not synchronized, all expressions must be created and used by one thread.
+inline bool& interning() { static bool enabled = true; return enabled; }
+
+// Set of symbol ids: bitset for the first ids, sorted overflow list for the rest
+class symbol_set
+{
+	static const uint32_t bits = 64;
+	uint64_t				_bits = 0;
+	std::vector<uint32_t>	_more;
+public:
+	bool empty() const { return !_bits && _more.empty(); }
+	bool contains(uint32_t id) const { return id < bits ? (_bits >> id & 1) != 0 : std::binary_search(_more.begin(), _more.end(), id); }
+	void insert(uint32_t id) {
+		if(id < bits)	_bits |= uint64_t(1) << id;
+		else if(!contains(id))	_more.insert(std::upper_bound(_more.begin(), _more.end(), id), id);
+	}
+	symbol_set& operator |= (const symbol_set& s) {
+		_bits |= s._bits;
+		if(!s._more.empty()) {
+			std::vector<uint32_t> more;
+			std::set_union(_more.begin(), _more.end(), s._more.begin(), s._more.end(), std::back_inserter(more));
+			_more.swap(more);
+		}
+		return *this;
+	}
+	bool intersects(const symbol_set& s) const {
+		if(_bits & s._bits)	return true;
+		for(auto id : _more)	if(s.contains(id))	return true;
+		return false;
+	}
+};
+
+// Common part of all expression nodes
+struct node_base
+{
+	size_t	hash;				// structural hash, equal nodes have equal hashes
+	bool	loose;				// node can be equal to a different node (holds symbol values)
+	bool	interned = false;	// node is stored in intern table
+	bool	canonical = true;	// all children are exact and stored on the heap or in the arena of the node
+	const arena_pool	*pool = current_arena().get();		// arena of the node, null on the heap
+	symbol_set	vars;			// free symbols of the expression
+	uint64_t	degree = 0;		// packed degrees in the canonical variables x, y, z, set when the node is built
+	uint64_t	rank = 0;		// leading characters of the name of symbols and functions
+	node_base(size_t hash, bool loose) : hash(hash), loose(loose) {}
+	// Interned node over canonical children is the only one of its structure on the heap or in its arena:
+	// lookups reuse heap nodes and nodes of the active arena, and heap nodes are never made while an arena
+	// is active. Heap copies of arena nodes are made after the arena is left, so they may have equal twins there.
+	bool exact() const { return interned && !loose && canonical; }
+	// Exact child keeps a node made in the given arena (or on the heap, if null) canonical
+	bool exact_in(const arena_pool *arena) const { return exact() && (!pool || pool == arena); }
+};
+
+template<class Node> void destroy(const Node *node) { if(node->pool) node->~Node(); else delete node; }
+
+// Creates node in the active arena or on the heap
+template<class Node> std::shared_ptr<const Node> make_node(Node&& node)
+{
+	charge_node();
+	if(auto pool = current_arena())
+		return std::allocate_shared<Node>(arena_allocator<Node>{pool}, std::move(node));
+	return std::make_shared<Node>(std::move(node));
+}
+
+template<class Node> std::shared_ptr<const Node> make_node(Node&& node, void (*deleter)(const Node*))
+{
+	charge_node();
+	if(auto pool = current_arena()) {
+		arena_allocator<Node> alloc{pool};
+		return std::shared_ptr<const Node>(new(alloc.allocate(1)) Node(std::move(node)), deleter, alloc);
+	}
+	return std::shared_ptr<const Node>(new Node(std::move(node)), deleter);
+}
+
+// Hash-consing table: structurally identical nodes are stored only once on the heap and once in every arena.
+// Table keeps weak references, node is removed when the last expression using it is destroyed.
+// Nodes of an arena are only reused in it, results that leave the arena are copied to the heap by promote().
+template<class Node> class intern_table
+{
+	std::unordered_multimap<size_t, std::weak_ptr<const Node>> _nodes;
+
+	static void release(const Node *node) { get().erase(node->hash); destroy(node); }
+	void erase(size_t hash) {
+		auto range = _nodes.equal_range(hash);
+		for(auto it = range.first; it != range.second; )	it = it->second.expired() ? _nodes.erase(it) : ++it;
+	}
+
+public:
+	static intern_table& get() { static auto table = new intern_table(); return *table; }	// never destroyed, outlives static expressions
+	size_t size() const { return _nodes.size(); }
+
+	std::shared_ptr<const Node> insert(Node&& node)
+	{
+		if(!interning())	return make_node(std::move(node));
+		auto range = _nodes.equal_range(node.hash);
+		for(auto it = range.first; it != range.second; ++it) {
+			auto p = it->second.lock();
+			if(p && (!p->pool || p->pool == node.pool) && identical(*p, node))	return p;
+		}
+		node.interned = true;
+		auto p = make_node(std::move(node), release);
+		_nodes.emplace(p->hash, p);
+		return p;
+	}
+};
+
+// Names of symbols, every name gets a dense id which stays the same while the process runs.
+// Reserved constants are registered first, then the canonical variables, names are only looked up for printing.
+class symbol_table
+{
+	std::unordered_map<std::string, uint32_t> _ids;
+	std::deque<std::string> _names;
+	symbol_table() { id("#e"); id("#p"); id("x"); id("y"); id("z"); }
+public:
+	enum : uint32_t { const_e, const_pi, reserved, var_x = reserved, var_y, var_z };
+	static symbol_table& get() { static auto table = new symbol_table(); return *table; }
+	size_t size() const { return _names.size(); }
+
+	uint32_t id(const std::string& name) {
+		auto it = _ids.find(name);
+		if(it != _ids.end())	return it->second;
+		_names.push_back(name);
+		return _ids[name] = uint32_t(_names.size() - 1);
+	}
+	const std::string& name(uint32_t id) const { return _names[id]; }
+};
+
+// Immutable expression node, copies share the same instance
+template<class Node> class shared_node
+{
+	std::shared_ptr<const Node> _node;
+protected:
+	shared_node(Node&& node, bool intern = true) : _node(intern ? intern_table<Node>::get().insert(std::move(node)) : make_node(std::move(node))) {}
+public:
+	const Node& node() const { return *_node; }
+	const Node* id() const { return _node.get(); }
+};
+
+// Distinct nodes are never equal if both are exact and come from the same storage
+// (heap copies of arena nodes are interned separately)
+template<class T> bool exact(const T& lh, const T& rh) { return lh.node().exact() && rh.node().exact() && lh.node().pool == rh.node().pool; }
+
+// Distinct nodes can be equal only if their hashes match and they are not both exact
+template<class T> bool maybe_equal(const T& lh, const T& rh) { return lh.node().hash == rh.node().hash && !exact(lh, rh); }
+
+}
+
+// Enables or disables hash-consing of new expression nodes, returns previous mode
+inline bool set_interning(bool enable) { std::swap(detail::interning(), enable); return enable; }
+
+}
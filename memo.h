@@ -0,0 +1,123 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <boost/functional/hash.hpp>
+#include "budget.h"
+
+namespace cas {
+namespace detail {
+
+// Results of an operation on (expression, variable) pairs, least recently used entries are evicted first.
+// Entries are matched by identical nodes, so symbols with different values never share a result.
+template<class Expr> class memo_table
+{
+	struct entry { Expr e, x, result; };
+	typedef typename std::list<entry>::iterator iterator;
+
+	std::list<entry>							_entries;		// most recently used first
+	std::unordered_multimap<size_t, iterator>	_index;
+	size_t	_capacity;
+	size_t	_hits = 0;
+	size_t	_misses = 0;
+
+	static size_t key(const Expr& e, const Expr& x) { size_t seed = hash_of(e); boost::hash_combine(seed, hash_of(x)); return seed; }
+
+public:
+	explicit memo_table(size_t capacity) : _capacity(capacity) {}
+	size_t size() const { return _entries.size(); }
+	size_t hits() const { return _hits; }
+	size_t misses() const { return _misses; }
+
+	bool find(const Expr& e, const Expr& x, Expr& result) {
+		auto range = _index.equal_range(key(e, x));
+		for(auto it = range.first; it != range.second; ++it) {
+			if(identical(it->second->e, e) && identical(it->second->x, x)) {
+				_entries.splice(_entries.begin(), _entries, it->second);
+				result = it->second->result;
+				return ++_hits, true;
+			}
+		}
+		return ++_misses, false;
+	}
+
+	void insert(const Expr& e, const Expr& x, const Expr& result) {
+		if(!_capacity)	return;
+		if(_entries.size() >= _capacity) {
+			auto last = std::prev(_entries.end());
+			auto range = _index.equal_range(key(last->e, last->x));
+			for(auto it = range.first; it != range.second; ++it)	if(it->second == last) { _index.erase(it); break; }
+			_entries.pop_back();
+		}
+		_entries.push_front({e, x, result});
+		_index.emplace(key(e, x), _entries.begin());
+	}
+
+	// Visits entries from the least recently used one, so inserting them in this order restores the table
+	template<class F> void for_each(F f) const {
+		for(auto it = _entries.rbegin(); it != _entries.rend(); ++it)	f(it->e, it->x, it->result);
+	}
+};
+
+// Scoped memo table of one operation: it is used while the scope is active, nested scopes hide the outer one.
+// A scope that lives as long as the program acts as a global cache bounded by its capacity.
+template<class Op, class Expr> class memo_scope
+{
+	std::shared_ptr<memo_table<Expr>> _table;
+	std::shared_ptr<memo_table<Expr>> _prev;
+public:
+	static std::shared_ptr<memo_table<Expr>>& current() { static std::shared_ptr<memo_table<Expr>> table; return table; }
+
+	explicit memo_scope(size_t capacity = 64 * 1024) : _table(std::make_shared<memo_table<Expr>>(capacity)), _prev(current()) { current() = _table; }
+	~memo_scope() { current() = _prev; }
+	memo_scope(const memo_scope&) = delete;
+	memo_scope& operator = (const memo_scope&) = delete;
+	size_t size() const { return _table->size(); }
+	size_t hits() const { return _table->hits(); }
+	size_t misses() const { return _table->misses(); }
+	memo_table<Expr>& table() const { return *_table; }
+};
+
+// Results of a recursive operation per visited node, so every shared subtree is processed once.
+// Keys hold their nodes, addresses of visited nodes are not reused while the memo exists.
+template<class Expr> class node_memo
+{
+	std::unordered_map<const void *, std::pair<Expr, Expr>> _done;
+public:
+	size_t size() const { return _done.size(); }
+
+	template<class F> Expr operator()(const Expr& e, F f) {
+		auto id = node_id(e);
+		if(!id)	return f(e);
+		auto it = _done.find(id);
+		if(it != _done.end())	return it->second.second;
+		auto result = f(e);
+		_done.emplace(id, std::make_pair(e, result));
+		return result;
+	}
+};
+
+// Node memo of the outermost call of an operation, nested calls with the same argument share it
+template<class Op, class Expr> class traversal
+{
+	node_memo<Expr>	_memo;
+	Expr			_arg;
+	traversal		*_prev;
+
+	static traversal*& current() { static traversal *scope = nullptr; return scope; }
+	explicit traversal(const Expr& arg) : _arg(arg), _prev(current()) { current() = this; }
+	~traversal() { current() = _prev; }
+
+public:
+	template<class F> static Expr apply(const Expr& e, const Expr& arg, F f) {
+		depth_guard depth;
+		auto scope = current();
+		if(scope && identical(scope->_arg, arg))	return scope->_memo(e, f);
+		traversal outer(arg);
+		return outer._memo(e, f);
+	}
+};
+
+}
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+#include "bigint.h"
+#include "factor.h"
+
+namespace cas {
+
+// Arithmetic modulo an odd n < 2³¹ in Montgomery form: x is kept as x∙2³² mod n, so products are reduced by
+// two multiplications and a shift instead of a 64-bit division. Inverses and powers require a prime n.
+class montgomery
+{
+	uint32_t	_n;
+	uint32_t	_ninv;			// -n⁻¹ mod 2³²
+	uint32_t	_r2;			// 2⁶⁴ mod n
+
+public:
+	explicit montgomery(uint32_t n) : _n(n), _r2((uint32_t)((0ull - n) % n)) {
+		uint32_t inv = n;											// n∙n ≡ 1 mod 8, each step doubles the correct bits
+		for(int i = 0; i < 4; i++)	inv *= 2 - n * inv;
+		_ninv = 0u - inv;
+	}
+	uint32_t modulus() const { return _n; }
+
+	// t∙2⁻³² mod n for t < n∙2³²
+	uint32_t reduce(uint64_t t) const {
+		uint32_t m = (uint32_t)t * _ninv;
+		uint32_t r = (uint32_t)((t + (uint64_t)m * _n) >> 32);
+		return r >= _n ? r - _n : r;
+	}
+	uint32_t to(uint32_t x) const { return reduce((uint64_t)(x % _n) * _r2); }
+	uint32_t from(uint32_t x) const { return reduce(x); }
+	uint32_t one() const { return to(1); }
+
+	uint32_t add(uint32_t a, uint32_t b) const { uint32_t s = a + b; return s >= _n ? s - _n : s; }
+	uint32_t sub(uint32_t a, uint32_t b) const { return a >= b ? a - b : a + _n - b; }
+	uint32_t mul(uint32_t a, uint32_t b) const { return reduce((uint64_t)a * b); }
+	uint32_t pow(uint32_t x, uint32_t e) const {
+		uint32_t r = one();
+		for(; e; e /= 2, x = mul(x, x))	if(e % 2)	r = mul(r, x);
+		return r;
+	}
+	uint32_t inverse(uint32_t x) const { return pow(x, _n - 2); }			// Fermat, x ≠ 0
+
+	// Element-wise operations on vectors of equal size in Montgomery form: loops without branches on the data,
+	// so the compiler can vectorize them
+	void to(std::vector<uint32_t>& x) const { for(auto& v : x)	v = to(v); }
+	void from(std::vector<uint32_t>& x) const { for(auto& v : x)	v = from(v); }
+	void add(std::vector<uint32_t>& x, const std::vector<uint32_t>& y) const { for(size_t i = 0; i < x.size(); i++)	x[i] = add(x[i], y[i]); }
+	void sub(std::vector<uint32_t>& x, const std::vector<uint32_t>& y) const { for(size_t i = 0; i < x.size(); i++)	x[i] = sub(x[i], y[i]); }
+	void mul(std::vector<uint32_t>& x, const std::vector<uint32_t>& y) const { for(size_t i = 0; i < x.size(); i++)	x[i] = mul(x[i], y[i]); }
+	// x += y∙c, the inner loop of dot products and polynomial multiplication
+	void mul_add(std::vector<uint32_t>& x, const std::vector<uint32_t>& y, uint32_t c) const { for(size_t i = 0; i < x.size(); i++)	x[i] = add(x[i], mul(y[i], c)); }
+};
+
+// Residue modulo the prime of a montgomery context, the context must outlive it.
+// Operands of arithmetic must have the same modulus, residues modulo different primes are never equal.
+class modint
+{
+	const montgomery*	_m;
+	uint32_t			_x;			// Montgomery form
+
+	modint(const montgomery& m, uint32_t x, bool) : _m(&m), _x(x) {}
+	static const montgomery& common(const modint& lh, const modint& rh) { assert(lh._m->modulus() == rh._m->modulus()); return *lh._m; }
+
+public:
+	modint(const montgomery& m, long long x) : _m(&m) {
+		auto n = m.modulus();
+		auto r = (uint32_t)((x < 0 ? 0ull - (unsigned long long)x : (unsigned long long)x) % n);
+		_x = m.to(x < 0 && r ? n - r : r);
+	}
+	const montgomery& context() const { return *_m; }
+	uint32_t value() const { return _m->from(_x); }
+
+	friend modint operator - (const modint& x) { return {*x._m, x._m->sub(0, x._x), true}; }
+	friend modint operator + (const modint& lh, const modint& rh) { auto& m = common(lh, rh); return {m, m.add(lh._x, rh._x), true}; }
+	friend modint operator - (const modint& lh, const modint& rh) { auto& m = common(lh, rh); return {m, m.sub(lh._x, rh._x), true}; }
+	friend modint operator * (const modint& lh, const modint& rh) { auto& m = common(lh, rh); return {m, m.mul(lh._x, rh._x), true}; }
+	friend modint inverse(const modint& x) { return {*x._m, x._m->inverse(x._x), true}; }
+	friend modint pow(const modint& x, uint32_t e) { return {*x._m, x._m->pow(x._x, e), true}; }
+	friend bool operator == (const modint& lh, const modint& rh) { return lh._x == rh._x && lh._m->modulus() == rh._m->modulus(); }
+	friend bool operator != (const modint& lh, const modint& rh) { return !(lh == rh); }
+};
+
+// i-th prime below 2³¹ in descending order, moduli of multimodular algorithms
+inline uint32_t modular_prime(size_t i) {
+	static std::vector<uint32_t> primes;
+	for(uint32_t p = primes.empty() ? 0x7fffffffu : primes.back() - 2; primes.size() <= i; p -= 2)
+		if(detail::is_prime(p))	primes.push_back(p);
+	return primes[i];
+}
+
+// x mod p in [0, p)
+inline uint32_t residue(const bigint& x, uint32_t p) {
+	uint64_t r = 0;
+	for(auto it = x.limbs().rbegin(); it != x.limbs().rend(); ++it)	r = (r << 32 | *it) % p;
+	return x.negative() && r ? p - (uint32_t)r : (uint32_t)r;
+}
+
+// x ≡ residues[i] mod primes[i] with |x| ≤ ∏p/2, by Garner's mixed-radix conversion: x = v₀ + v₁p₀ + v₂p₀p₁ + …
+inline bigint crt(const std::vector<uint32_t>& residues, const std::vector<uint32_t>& primes) {
+	std::vector<uint32_t> v(primes.size());
+	for(size_t i = 0; i < primes.size(); i++) {
+		auto p = primes[i];
+		uint64_t u = 0, m = 1;												// partial sum and product of the previous primes mod p
+		for(size_t j = i; j--; )	u = (u * primes[j] + v[j]) % p;
+		for(size_t j = 0; j < i; j++)	m = m * primes[j] % p;
+		v[i] = detail::mulmod((residues[i] + p - u) % p, detail::powmod(m, p - 2, p), p);
+	}
+	bigint x, m{1};
+	for(size_t j = primes.size(); j--; )	x = x * bigint{primes[j]} + bigint{v[j]};
+	for(auto p : primes)	m = m * bigint{p};
+	return m < x + x ? x - m : x;
+}
+
+// Fraction n/d ≡ a mod m with |n|, d ≤ √(m/2), by the extended Euclidean algorithm stopped halfway (Wang, 1981).
+// Such a fraction is unique, false if there is none.
+inline bool rational_reconstruction(const bigint& a, const bigint& m, bigrat& r) {
+	bigint bound = detail::iroot(m / bigint{2}, 2), r0 = m, r1 = a % m, t0, t1{1};
+	if(r1.negative())	r1 = r1 + m;
+	while(bound < r1) {
+		bigint q = r0 / r1, r2 = r0 - q * r1, t2 = t0 - q * t1;
+		r0 = std::move(r1), r1 = std::move(r2), t0 = std::move(t1), t1 = std::move(t2);
+	}
+	bigint d = t1.negative() ? -t1 : t1;
+	if(d.is_zero() || bound < d || gcd(r1, d) != bigint{1})	return false;
+	r = bigrat::reduced(t1.negative() ? -r1 : r1, d);
+	return true;
+}
+
+}
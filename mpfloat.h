@@ -0,0 +1,71 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <type_traits>
+#include <boost/functional/hash.hpp>
+#include <boost/multiprecision/cpp_bin_float.hpp>
+#include <boost/multiprecision/cpp_complex.hpp>
+
+namespace cas {
+
+// Multiprecision floating point of approx: computed with max_digits decimal digits and rounded to the requested ones
+const unsigned max_digits = 100;
+using mpreal_t = boost::multiprecision::number<boost::multiprecision::cpp_bin_float<max_digits>, boost::multiprecision::et_off>;
+using mpcomplex_t = boost::multiprecision::number<boost::multiprecision::complex_adaptor<boost::multiprecision::cpp_bin_float<max_digits>>, boost::multiprecision::et_off>;
+
+namespace detail {
+
+inline unsigned& current_digits() { static unsigned digits = 0; return digits; }
+inline bool& enclosing() { static bool enclose = false; return enclose; }
+
+inline mpreal_t round_digits(const mpreal_t& x, unsigned digits) {
+	if(digits >= max_digits || x == 0 || !boost::multiprecision::isfinite(x))	return x;
+	int bits = (int)(digits * 3.3219280948873623) + 8, e;		// guard bits keep the last decimal digit correctly rounded
+	auto m = frexp(x, &e);
+	return ldexp(round(ldexp(m, bits)), e - bits);
+}
+inline mpcomplex_t round_digits(const mpcomplex_t& x, unsigned digits) { return {round_digits(x.real(), digits), round_digits(x.imag(), digits)}; }
+
+}
+
+// Floating-point number that knows its decimal precision, results of operations get the lower one of the operands.
+// The value is immutable and kept on the heap, so numeric_t stays as small as its machine-number alternatives.
+template<class T> class multiprecision
+{
+	std::shared_ptr<const T>	_value;
+	unsigned					_digits;
+public:
+	multiprecision(const T& value, unsigned digits) : _value(std::make_shared<const T>(detail::round_digits(value, digits))), _digits(std::min(digits, max_digits)) {}
+	const T& value() const { return *_value; }
+	unsigned digits() const { return _digits; }
+	std::string str() const { return _value->str(_digits); }
+	size_t hash() const { return boost::hash_value((double)abs(*_value)); }
+
+	friend bool operator == (const multiprecision& lh, const multiprecision& rh) { return lh._value == rh._value || *lh._value == *rh._value; }
+};
+
+using mpreal = multiprecision<mpreal_t>;
+using mpcomplex = multiprecision<mpcomplex_t>;
+
+template<class T> size_t hash_value(const multiprecision<T>& x) { return x.hash(); }
+template<class T> struct is_multiprecision : std::false_type {};
+template<class T> struct is_multiprecision<multiprecision<T>> : std::true_type {};
+
+// Scoped precision of approx in decimal digits, 0 approximates with double. With enclose, real values are
+// approximated by balls of this working precision.
+class approx_precision
+{
+	unsigned	_prev;
+	bool		_prev_enclose;
+public:
+	explicit approx_precision(unsigned digits, bool enclose = false) : _prev(detail::current_digits()), _prev_enclose(detail::enclosing()) {
+		detail::current_digits() = std::min(digits, max_digits);
+		detail::enclosing() = enclose && digits;
+	}
+	~approx_precision() { detail::current_digits() = _prev; detail::enclosing() = _prev_enclose; }
+	approx_precision(const approx_precision&) = delete;
+	approx_precision& operator = (const approx_precision&) = delete;
+};
+
+}
@@ -1,17 +1,57 @@
 #pragma once
 
 #include "common.h"
+#include "factor.h"
+
+namespace cas {
+	namespace detail {
+	// Kinds of operands of the generic powers: gaussian rationals, multiprecision numbers and balls.
+	// Balls with complex operands have no error bounds and are computed as multiprecision numbers.
+	template<class T> struct is_gaussian : std::is_same<T, gaussian> {};
+	template<class T> struct is_complex : std::integral_constant<bool, std::is_same<T, complex_t>::value || std::is_same<T, mpcomplex>::value || is_gaussian<T>::value> {};
+	template<class T> struct is_ball : std::is_same<T, ball> {};
+	template<class T> struct is_multi : std::integral_constant<bool, is_multiprecision<T>::value || is_ball<T>::value> {};
+	template<class T, class U> struct is_enclosed : std::integral_constant<bool, (is_ball<T>::value || is_ball<U>::value) && !is_complex<T>::value && !is_complex<U>::value> {};
+	template<class T, class U, class R = expr> using if_ball = std::enable_if_t<is_enclosed<T, U>::value, R>;
+	template<class T, class U, class R = expr> using if_multi = std::enable_if_t<!is_enclosed<T, U>::value && (is_multi<T>::value || is_multi<U>::value), R>;
+	template<class T, class U, class R = expr> using if_gaussian = std::enable_if_t<!is_multi<T>::value && !is_multi<U>::value && (is_gaussian<T>::value || is_gaussian<U>::value), R>;
+	}
+}
 
 namespace {
 	using namespace cas;
 	expr pow(int_t lh, int_t rh);
-	rational_t pow(rational_t lh, int_t rh);
+	expr pow(rational_t lh, int_t rh);
 	expr pow(int_t x, rational_t rh);
 	real_t pow(rational_t lh, real_t rh);
 	real_t pow(real_t lh, rational_t rh);
 	complex_t pow(rational_t lh, complex_t rh);
 	complex_t pow(complex_t lh, rational_t rh);
 	expr pow(rational_t lh, rational_t rh);
+	expr pow(const bigint& lh, int_t rh);
+	expr pow(int_t lh, const bigint& rh);
+	real_t pow(const bigint& lh, const bigint& rh);
+	expr pow(const bigint& lh, rational_t rh);
+	real_t pow(rational_t lh, const bigint& rh);
+	real_t pow(const bigint& lh, real_t rh);
+	real_t pow(real_t lh, const bigint& rh);
+	complex_t pow(const bigint& lh, complex_t rh);
+	complex_t pow(complex_t lh, const bigint& rh);
+	expr pow(const bigrat& lh, int_t rh);
+	real_t pow(int_t lh, const bigrat& rh);
+	real_t pow(const bigrat& lh, rational_t rh);
+	real_t pow(rational_t lh, const bigrat& rh);
+	real_t pow(const bigrat& lh, real_t rh);
+	real_t pow(real_t lh, const bigrat& rh);
+	complex_t pow(const bigrat& lh, complex_t rh);
+	complex_t pow(complex_t lh, const bigrat& rh);
+	real_t pow(const bigrat& lh, const bigint& rh);
+	real_t pow(const bigint& lh, const bigrat& rh);
+	real_t pow(const bigrat& lh, const bigrat& rh);
+	expr pow(const gaussian& lh, int_t rh);
+	template<class T, class U> detail::if_gaussian<T, U> pow(const T& lh, const U& rh);
+	template<class T, class U> detail::if_multi<T, U> pow(const T& lh, const U& rh);
+	template<class T, class U> detail::if_ball<T, U> pow(const T& lh, const U& rh);
 }
 
 namespace cas {
@@ -19,29 +59,7 @@ namespace cas {
 	template<class T> int sgn(T val) { return (T(0) < val) - (val < T(0)); }
 	template<class T> T div(T x, T y, T& r) { T d = x / y; r = x - d*y; return d; }
 	template<class T> T pwr(T x, T y) { T t; return y == 0 ? 1 : y % 2 == 0 ? t = pwr(x, y / 2), t*t : x*pwr(x, y - 1); }
-	static int_t gcd(int_t a, int_t b) { return b == 0 ? labs(a) : gcd(b, a % b); }
 	static void normalize(int_t& a, int_t& b) { auto d = gcd(a, b); if(d) a /= d, b /= d; }
-	template<class T> T isqrt(T n) {
-		T b = 0;
-		while(n >= 0) { n = n - b; b = b + 1; n = n - b; }
-		return b - 1;
-	}
-	template<class T> void powerize(T& x, T&e) {
-		T n = isqrt(x), y = x;
-		for(x = 2; x <= n; x++)
-			for(e = n + 1; e>1; e--)	if(pwr(x, e) == y)	return;
-		x = y; e = 1;
-	}
-	static std::vector<std::pair<int_t, int_t>> factorize(int_t x) {
-		std::vector<std::pair<int_t, int_t>> res;
-		int_t r, prime, count = 0;
-		while((prime = (int_t)boost::math::prime(count++)) <= x) {
-			int_t tmp = x, c = 0;
-			while(tmp = div(tmp, prime, r), r == 0)	c++;
-			if(c)	res.emplace_back(prime, c);
-		}
-		return res;
-	}
 
 	const expr zero = numeric{ 0 };
 	const expr one = numeric{ 1 };
@@ -52,7 +70,7 @@ namespace cas {
 	const expr minf = numeric{ -1, 0 };
 
 	inline expr make_num(expr value) { return value; }
-	inline expr make_num(rational_t value) { return make_num(value.numer(), value.denom()); }
+	inline expr make_num(rational_t value) { return value.denom() == 1 ? numeric_t{value.numer()} : numeric_t{value}; }		// rational_t is reduced
 	inline expr make_num(int_t value) { return numeric_t{value}; }
 	inline expr make_num(int_t numer, int_t denom) {
 		normalize(numer, denom);
@@ -61,87 +79,361 @@ namespace cas {
 		if(denom == 1) 		return{numer};
 		return numeric_t{rational_t{numer, denom}};
 	}
-	inline expr make_num(real_t value) { if(value - (int_t)value == 0) return numeric_t{(int_t)value}; else return numeric_t{value}; }
+	inline expr make_num(real_t value) {
+		if(value >= std::numeric_limits<int_t>::min() && value <= std::numeric_limits<int_t>::max() && value - (int_t)value == 0)	return numeric_t{(int_t)value};
+		return numeric_t{value};
+	}
 	inline expr make_num(real_t real, real_t imag) { return make_num(complex_t{real, imag}); }
 	inline expr make_num(complex_t value) {
 		if(abs(value.imag()) <= std::numeric_limits<real_t>::epsilon())	return make_num(value.real());
 		return numeric_t{value};
 	}
+	inline expr make_num(bigint value) { return numeric{std::move(value)}; }
+	inline expr make_num(bigrat value) {
+		if(value.denom() == bigint{1})	return make_num(value.numer());
+		if(value.numer().fits_int() && value.denom().fits_int())	return numeric_t{rational_t::reduced((int_t)value.numer().to_ll(), (int_t)value.denom().to_ll())};
+		return numeric_t{std::move(value)};
+	}
+	inline expr make_num(mpreal value) {
+		auto& x = value.value();
+		if(x >= std::numeric_limits<int_t>::min() && x <= std::numeric_limits<int_t>::max() && x == trunc(x))	return numeric_t{x.convert_to<int_t>()};
+		return numeric_t{std::move(value)};
+	}
+	inline expr make_num(ball value) { return numeric_t{std::move(value)}; }
+	inline expr make_num(mpcomplex value) {
+		auto& x = value.value();
+		if(abs(x.imag()) <= pow(mpreal_t{10}, -(int)value.digits()) * abs(x.real()))	return make_num(mpreal{x.real(), value.digits()});
+		return numeric_t{std::move(value)};
+	}
+	inline expr make_num(gaussian value) {
+		if(value.im().numer().is_zero())	return make_num(value.re());
+		return numeric_t{std::move(value)};
+	}
 
-	inline rational_t::rational_t(int_t numer, int_t denom) : _numer(numer), _denom(denom) { normalize(_numer, _denom); }
+	inline rational_t::rational_t(int_t numer, int_t denom) : _numer(numer), _denom(denom) {
+		normalize(_numer, _denom);
+		if(_denom < 0)	_numer = -_numer, _denom = -_denom;
+	}
 
-	inline expr numeric::approx() const { return _value.type() == typeid(rational_t) ? make_num(boost::get<rational_t>(_value).value()) : *this; };
 	inline expr numeric::simplify() const { 
 		switch(_value.which()) {
 		case 0:	return make_num(boost::get<int_t>(_value));
 		case 1:	return make_num(boost::get<rational_t>(_value).numer(), boost::get<rational_t>(_value).denom());
 		case 2:	return make_num(boost::get<real_t>(_value));
 		case 3:	return make_num(boost::get<complex_t>(_value));
+		case 4:	return make_num(boost::get<bigint>(_value));
+		case 5:	return make_num(boost::get<bigrat>(_value));
+		case 6:	return make_num(boost::get<mpreal>(_value));
+		case 7:	return make_num(boost::get<mpcomplex>(_value));
+		case 8:	return make_num(boost::get<ball>(_value));
+		case 9:	return make_num(boost::get<gaussian>(_value));
 		}
 		return expr{*this};
 	};
-	inline expr numeric::subst(pair<expr, expr> s) const { return{*this}; }
-	inline bool numeric::match(expr e, match_result& res) const { if(e != expr{*this}) res.found = false; return res; };
+	inline expr numeric::subst(const pair<expr, expr>& s) const { return{*this}; }
+	inline bool numeric::match(const expr& e, match_result& res) const { if(e != expr{*this}) res.found = false; return res; };
 	inline unsigned numeric::exponents(const list_t& vars) const { return 0; }
 
-	inline rational_t operator + (rational_t lh, int_t rh) { return {lh.numer() + lh.denom() * rh, lh.denom()}; }
-	inline rational_t operator + (int_t lh, rational_t rh) { return {rh.numer() + rh.denom() * lh, rh.denom()}; }
-	inline real_t operator + (rational_t lh, real_t rh) { return lh.value() + rh; }
-	inline real_t operator + (real_t lh, rational_t rh) { return lh + rh.value(); }
-	inline complex_t operator + (rational_t lh, complex_t rh) { return lh.value() + rh; }
-	inline complex_t operator + (complex_t lh, rational_t rh) { return lh + rh.value(); }
-	inline rational_t operator + (rational_t lh, rational_t rh) { return{lh.numer() * rh.denom() + rh.numer() * lh.denom(), lh.denom() * rh.denom()}; }
-	inline complex_t operator + (complex_t lh, int_t rh) { return lh + (real_t)rh; }
-	inline complex_t operator + (int_t lh, complex_t rh) { return (real_t)lh + rh; }
-
-	inline rational_t operator * (rational_t lh, int_t rh) { return {lh.numer() * rh, lh.denom()}; }
-	inline rational_t operator * (int_t lh, rational_t rh) { return {rh.numer() * lh, rh.denom()}; }
-	inline real_t operator * (rational_t lh, real_t rh) { return lh.value() * rh; }
-	inline real_t operator * (real_t lh, rational_t rh) { return lh * rh.value(); }
-	inline complex_t operator * (rational_t lh, complex_t rh) { return lh.value() * rh; }
-	inline complex_t operator * (complex_t lh, rational_t rh) { return lh * rh.value(); }
-	inline rational_t operator * (rational_t lh, rational_t rh) { return{lh.numer() * rh.numer(), lh.denom() * rh.denom()}; }
-	inline complex_t operator * (complex_t lh, int_t rh) { return lh * (real_t)rh; }
-	inline complex_t operator * (int_t lh, complex_t rh) { return (real_t)lh * rh; }
-
-	struct num_less : public boost::static_visitor<bool>
-	{
-	public:
-		template <typename T, typename U> bool operator()(T lh, U rh) const { return lh < rh; }
-		template <typename T> bool operator()(complex_t lh, T rh) const { return lh.real() < (real_t)rh; }
-		template <typename T> bool operator()(T lh, complex_t rh) const { return (real_t)lh < rh.real(); }
-		bool operator()(complex_t lh, complex_t rh) const { return abs(lh) < abs(rh); }
+	namespace detail {
+
+	inline real_t inexact(int_t x) { return x; }
+	inline real_t inexact(rational_t x) { return x.value(); }
+	inline real_t inexact(real_t x) { return x; }
+	inline complex_t inexact(complex_t x) { return x; }
+	inline real_t inexact(const bigint& x) { return (real_t)x; }
+	inline real_t inexact(const bigrat& x) { return (real_t)x; }
+	inline real_t inexact(const mpreal& x) { return x.value().convert_to<real_t>(); }
+	inline complex_t inexact(const mpcomplex& x) { return {x.value().real().convert_to<real_t>(), x.value().imag().convert_to<real_t>()}; }
+	inline real_t inexact(const ball& x) { return x.mid().convert_to<real_t>(); }
+	inline complex_t inexact(const gaussian& x) { return {(real_t)x.re(), (real_t)x.im()}; }
+
+	// Operands of multiprecision operations, exact ones are rounded to max_digits
+	inline mpreal_t multi(int_t x) { return x; }
+	inline mpreal_t multi(rational_t x) { return mpreal_t{x.numer()} / x.denom(); }
+	inline mpreal_t multi(real_t x) { return x; }
+	inline mpcomplex_t multi(complex_t x) { return {x.real(), x.imag()}; }
+	inline mpreal_t multi(const bigint& x) {
+		mpreal_t r = 0;
+		for(auto it = x.limbs().rbegin(); it != x.limbs().rend(); ++it)	r = ldexp(r, 32) + *it;
+		return x.negative() ? -r : r;
+	}
+	inline mpreal_t multi(const bigrat& x) { return multi(x.numer()) / multi(x.denom()); }
+	template<class T> const T& multi(const multiprecision<T>& x) { return x.value(); }
+	inline const mpreal_t& multi(const ball& x) { return x.mid(); }
+	inline mpcomplex_t multi(const gaussian& x) { return {multi(x.re()), multi(x.im())}; }
+
+	template<class T> unsigned digits_of(const T&) { return max_digits; }
+	template<class T> unsigned digits_of(const multiprecision<T>& x) { return x.digits(); }
+	inline unsigned digits_of(const ball& x) { return x.digits(); }
+	template<class T, class U> unsigned digits_of(const T& lh, const U& rh) { return std::min(digits_of(lh), digits_of(rh)); }
+
+	inline expr make_mp(const mpreal_t& x, unsigned digits) { return make_num(mpreal{x, digits}); }
+	inline expr make_mp(const mpcomplex_t& x, unsigned digits) { return make_num(mpcomplex{x, digits}); }
+	inline const mpreal_t& real_part(const mpreal_t& x) { return x; }
+
+	// Balls of real operands: binary floating-point values are exact, conversions of other ones are rounded
+	inline ball enclose(int_t x, unsigned digits) { return {x, 0, digits}; }
+	inline ball enclose(real_t x, unsigned digits) { return {x, 0, digits}; }
+	inline ball enclose(const mpreal& x, unsigned digits) { return {x.value(), 0, digits}; }
+	inline const ball& enclose(const ball& x, unsigned digits) { return x; }
+	inline ball enclose(rational_t x, unsigned digits) { auto v = multi(x); return {v, abs(v) * ball::eps(), digits}; }
+	inline ball enclose(const bigint& x, unsigned digits) { auto v = multi(x); return {v, abs(v) * ball::eps() * (int)x.limbs().size(), digits}; }
+	inline ball enclose(const bigrat& x, unsigned digits) { auto v = multi(x); return {v, abs(v) * ball::eps() * (int)(x.numer().limbs().size() + x.denom().limbs().size() + 1), digits}; }
+
+	// Value of approx with a precision: a ball while enclosing, otherwise a multiprecision number
+	template<class T> expr approximate(const T& x, unsigned digits) { return enclosing() ? make_num(enclose(x, digits)) : make_mp(multi(x), digits); }
+	inline expr approximate(complex_t x, unsigned digits) { return make_mp(multi(x), digits); }
+	inline expr approximate(const mpcomplex& x, unsigned digits) { return make_mp(multi(x), digits); }
+	inline expr approximate(const gaussian& x, unsigned digits) { return make_mp(multi(x), digits); }
+	inline mpreal_t real_part(const mpcomplex_t& x) { return x.real(); }
+
+	inline bigrat exact(int_t x) { return bigrat::reduced(bigint{x}, bigint{1}); }
+	inline bigrat exact(rational_t x) { return bigrat::reduced(bigint{x.numer()}, bigint{x.denom()}); }
+	inline bigrat exact(const bigint& x) { return bigrat::reduced(x, bigint{1}); }
+	inline const bigrat& exact(const bigrat& x) { return x; }
+
+	// Coprime numerator and positive denominator as int_t, rational_t or bigrat, whichever holds them
+	inline expr make_rat(long long numer, long long denom) {
+		if(numer == 0)	return zero;
+		if(denom == 1)	return numer == (int_t)numer ? make_num((int_t)numer) : make_num(bigint{numer});
+		if(numer == (int_t)numer && denom == (int_t)denom)	return numeric_t{rational_t::reduced((int_t)numer, (int_t)denom)};
+		return make_num(bigrat::reduced(bigint{numer}, bigint{denom}));
+	}
+
+	// Operands of int_t are at most 31 bits, so sums and products are computed in 64 bits. Fractions cancel common
+	// factors before multiplying (Knuth, 4.5.1): intermediates stay within 63 bits and results are already reduced.
+	// Results that do not fit int_t become bigint or bigrat. Infinities (zero denominators) keep the plain formulas.
+	inline expr add(int_t lh, int_t rh) { long long r = (long long)lh + rh; return r == (int_t)r ? make_num((int_t)r) : make_num(bigint{r}); }
+	inline expr mul(int_t lh, int_t rh) { long long r = (long long)lh * rh; return r == (int_t)r ? make_num((int_t)r) : make_num(bigint{r}); }
+	inline expr add(rational_t lh, int_t rh) { return make_rat(lh.numer() + (long long)lh.denom() * rh, lh.denom()); }
+	inline expr add(int_t lh, rational_t rh) { return add(rh, lh); }
+	inline expr add(rational_t lh, rational_t rh) {
+		long long n1 = lh.numer(), d1 = lh.denom(), n2 = rh.numer(), d2 = rh.denom();
+		if(!d1 || !d2)	return make_num((int_t)(n1 * d2 + n2 * d1), (int_t)(d1 * d2));
+		long long g = gcd(d1, d2), t = n1 * (d2 / g) + n2 * (d1 / g), g2 = gcd(t, g);
+		return make_rat(t / g2, d1 / g * (d2 / g2));
+	}
+	inline expr mul(rational_t lh, int_t rh) {
+		long long n = lh.numer(), d = lh.denom(), g = gcd<long long>(rh, d);
+		if(!d)	return make_num((int_t)(n * rh), 0);
+		return make_rat(n * (rh / g), d / g);
+	}
+	inline expr mul(int_t lh, rational_t rh) { return mul(rh, lh); }
+	inline expr mul(rational_t lh, rational_t rh) {
+		long long n1 = lh.numer(), d1 = lh.denom(), n2 = rh.numer(), d2 = rh.denom();
+		if(!d1 || !d2)	return make_num(sgn(n1 * n2), 0);
+		long long g1 = gcd(n1, d2), g2 = gcd(n2, d1);
+		return make_rat(n1 / g1 * (n2 / g2), d1 / g2 * (d2 / g1));
+	}
+	inline bool less_than(int_t lh, int_t rh) { return lh < rh; }
+	inline bool less_than(rational_t lh, int_t rh) { return lh.numer() < (long long)rh * lh.denom(); }
+	inline bool less_than(int_t lh, rational_t rh) { return (long long)lh * rh.denom() < rh.numer(); }
+	inline bool less_than(rational_t lh, rational_t rh) { return lh < rh; }
+
+	// Promotion lattice of sums, products and comparisons: both operands are converted once to the higher rank
+	// of the two and combined in the common type of that rank. Balls with complex operands have no error bounds
+	// and are computed as multiprecision numbers.
+	enum rank_t { exact_rank, big_rank, gaussian_rank, inexact_rank, multi_rank, ball_rank };
+	const rank_t ranks[] = {exact_rank, exact_rank, inexact_rank, inexact_rank, big_rank, big_rank, multi_rank, multi_rank, ball_rank, gaussian_rank};
+	static_assert(sizeof(ranks) / sizeof(ranks[0]) == boost::mpl::size<numeric_t::types>::value, "rank of each type of numeric_t");
+
+	inline bool is_integer(const numeric_t& x) { return x.type() == typeid(int_t) || x.type() == typeid(bigint); }
+	inline bool is_complex_num(const numeric_t& x) { return x.type() == typeid(complex_t) || x.type() == typeid(mpcomplex) || x.type() == typeid(gaussian); }
+	inline rank_t rank_of(const numeric_t& lh, const numeric_t& rh) {
+		auto rank = std::max(ranks[lh.which()], ranks[rh.which()]);
+		return rank == ball_rank && (is_complex_num(lh) || is_complex_num(rh)) ? multi_rank : rank;
+	}
+
+	// Operands converted to the common type of a rank, each one is of this or a lower rank
+	inline bigint to_bigint(const numeric_t& x) { return x.type() == typeid(int_t) ? bigint{boost::get<int_t>(x)} : boost::get<bigint>(x); }
+	inline bigrat to_bigrat(const numeric_t& x) {
+		switch(x.which()) {
+		case 0:	return exact(boost::get<int_t>(x));
+		case 1:	return exact(boost::get<rational_t>(x));
+		case 4:	return exact(boost::get<bigint>(x));
+		}
+		return boost::get<bigrat>(x);
+	}
+	inline gaussian to_gaussian(const numeric_t& x) { return x.type() == typeid(gaussian) ? boost::get<gaussian>(x) : gaussian{to_bigrat(x), {}}; }
+	inline real_t to_real(const numeric_t& x) { return boost::apply_visitor([](const auto& v) { return std::real(inexact(v)); }, x); }
+	inline complex_t to_complex(const numeric_t& x) { return boost::apply_visitor([](const auto& v) { return complex_t{inexact(v)}; }, x); }
+	inline mpreal_t to_mpreal(const numeric_t& x) { return boost::apply_visitor([](const auto& v) { return real_part(multi(v)); }, x); }
+	inline mpcomplex_t to_mpcomplex(const numeric_t& x) { return boost::apply_visitor([](const auto& v) { return mpcomplex_t{multi(v)}; }, x); }
+	inline ball to_ball(const numeric_t& x, unsigned digits) {
+		switch(x.which()) {
+		case 0:	return enclose(boost::get<int_t>(x), digits);
+		case 1:	return enclose(boost::get<rational_t>(x), digits);
+		case 2:	return enclose(boost::get<real_t>(x), digits);
+		case 4:	return enclose(boost::get<bigint>(x), digits);
+		case 5:	return enclose(boost::get<bigrat>(x), digits);
+		case 6:	return enclose(boost::get<mpreal>(x), digits);
+		}
+		return boost::get<ball>(x);
+	}
+	inline unsigned digits_of(const numeric_t& lh, const numeric_t& rh) { return boost::apply_visitor([](const auto& x, const auto& y) { return digits_of(x, y); }, lh, rh); }
+
+	// int_t and rational_t operands are combined by their own overloads
+	template<class F> auto exact_op(const numeric_t& lh, const numeric_t& rh, F f) {
+		auto x = boost::get<int_t>(&lh), y = boost::get<int_t>(&rh);
+		if(x && y)	return f(*x, *y);
+		if(x)		return f(*x, boost::get<rational_t>(rh));
+		if(y)		return f(boost::get<rational_t>(lh), *y);
+		return f(boost::get<rational_t>(lh), boost::get<rational_t>(rh));
+	}
+
+	// Integers stay bigint, other exact operands beyond int_t are combined as big fractions. Floating-point
+	// operands make the result approximate, multiprecision ones keep the lower precision of the two.
+	template<class E, class F> expr arithmetic(const numeric_t& lh, const numeric_t& rh, E exact_f, F f) {
+		switch(rank_of(lh, rh)) {
+		case exact_rank:	return exact_op(lh, rh, exact_f);
+		case big_rank:		return is_integer(lh) && is_integer(rh) ? make_num(f(to_bigint(lh), to_bigint(rh))) : make_num(f(to_bigrat(lh), to_bigrat(rh)));
+		case gaussian_rank:	return make_num(f(to_gaussian(lh), to_gaussian(rh)));
+		case inexact_rank:	return is_complex_num(lh) || is_complex_num(rh) ? make_num(f(to_complex(lh), to_complex(rh))) : make_num(f(to_real(lh), to_real(rh)));
+		case multi_rank:	return is_complex_num(lh) || is_complex_num(rh) ? make_mp(f(to_mpcomplex(lh), to_mpcomplex(rh)), digits_of(lh, rh)) : make_mp(f(to_mpreal(lh), to_mpreal(rh)), digits_of(lh, rh));
+		default:			{ auto d = digits_of(lh, rh); return make_num(f(to_ball(lh, d), to_ball(rh, d))); }
+		}
+	}
+
+	// Complex numbers are ordered by absolute values, mixed with other ones by real parts. Balls are ordered
+	// only if they do not overlap, so sign tests of enclosures are rigorous.
+	inline bool less_than(const numeric_t& lh, const numeric_t& rh) {
+		switch(rank_of(lh, rh)) {
+		case exact_rank:	return exact_op(lh, rh, [](auto x, auto y) { return less_than(x, y); });
+		case big_rank:		return to_bigrat(lh) < to_bigrat(rh);
+		case gaussian_rank:	return lh.which() == rh.which() ? to_gaussian(lh).norm() < to_gaussian(rh).norm() : to_gaussian(lh).re() < to_gaussian(rh).re();
+		case inexact_rank:	return lh.type() == typeid(complex_t) && rh.type() == typeid(complex_t) ? abs(boost::get<complex_t>(lh)) < abs(boost::get<complex_t>(rh)) : to_real(lh) < to_real(rh);
+		case multi_rank:	return lh.type() == typeid(mpcomplex) && rh.type() == typeid(mpcomplex) ? abs(to_mpcomplex(lh)) < abs(to_mpcomplex(rh)) : to_mpreal(lh) < to_mpreal(rh);
+		default:			{ auto d = digits_of(lh, rh); return to_ball(lh, d) < to_ball(rh, d); }
+		}
+	}
+	}
+
+	inline expr numeric::approx() const {
+		if(auto digits = detail::current_digits()) {
+			if(_value.type() == typeid(int_t) && !detail::enclosing())	return *this;
+			return boost::apply_visitor([digits](const auto& x) { return detail::approximate(x, std::min(digits, detail::digits_of(x))); }, _value);
+		}
+		if(_value.type() == typeid(ball))		return make_num(detail::inexact(boost::get<ball>(_value)));
+		if(_value.type() == typeid(mpreal))		return make_num(boost::get<mpreal>(_value).value().convert_to<real_t>());
+		if(_value.type() == typeid(mpcomplex))	return make_num(detail::inexact(boost::get<mpcomplex>(_value)));
+		if(_value.type() == typeid(rational_t))	return make_num(boost::get<rational_t>(_value).value());
+		if(_value.type() == typeid(bigint))		return numeric_t{(real_t)boost::get<bigint>(_value)};
+		if(_value.type() == typeid(bigrat))		return numeric_t{(real_t)boost::get<bigrat>(_value)};
+		if(_value.type() == typeid(gaussian))	return make_num(detail::inexact(boost::get<gaussian>(_value)));
+		return *this;
 	};
 
-	inline expr operator + (numeric_t op1, numeric_t op2) { return boost::apply_visitor([](auto x, auto y) {return make_num(x + y); }, op1, op2); }
-	inline expr operator * (numeric_t op1, numeric_t op2) { return boost::apply_visitor([](auto x, auto y) {return make_num(x * y); }, op1, op2); }
+	inline expr operator + (const numeric_t& op1, const numeric_t& op2) { return detail::arithmetic(op1, op2, [](auto x, auto y) { return detail::add(x, y); }, std::plus<>()); }
+	inline expr operator * (const numeric_t& op1, const numeric_t& op2) { return detail::arithmetic(op1, op2, [](auto x, auto y) { return detail::mul(x, y); }, std::multiplies<>()); }
 	inline expr operator ^ (numeric_t op1, numeric_t op2) { return boost::apply_visitor([](auto x, auto y) {return make_num(pow(x, y)); }, op1, op2); }
-	inline bool less(numeric_t op1, numeric_t op2) { return boost::apply_visitor(num_less(), op1, op2); }
+	inline bool less(const numeric_t& op1, const numeric_t& op2) { return detail::less_than(op1, op2); }
 }
 
 namespace {
 	using namespace cas;
-	expr pow(int_t lh, int_t rh) { return rh < 0 ? make_num(1, pwr(lh, -rh)) : pwr(lh, rh); }
-	rational_t pow(rational_t lh, int_t rh) { return rh < 0 ? rational_t{pwr(lh.denom(), -rh), pwr(lh.numer(), -rh)} : rational_t{pwr(lh.numer(), rh), pwr(lh.denom(), rh)}; }
+	expr pow(int_t lh, int_t rh) {
+		unsigned e = rh < 0 ? 0u - (unsigned)rh : (unsigned)rh;
+		long long r = 1;
+		if(lh == 0 || lh == 1)	r = e ? lh : 1;
+		else if(lh == -1)		r = e % 2 ? -1 : 1;
+		else for(; e; e--)		if((r *= lh) != (int_t)r)	return pow(bigint{lh}, rh);
+		return rh < 0 ? make_num(1, (int_t)r) : make_num((int_t)r);
+	}
+	expr pow(rational_t lh, int_t rh) { return pow(lh.numer(), rh) * pow(lh.denom(), -rh); }
+	// xᵃᐟᵇ = out∙inᵍᐟᵇ: whole powers of the prime factors are taken out, the rest is the smallest radicand.
+	// Roots of negative numbers are (-1)ᵃᐟᵇ∙|x|ᵃᐟᵇ.
 	expr pow(int_t x, rational_t rh) {
-		int_t e, a = rh.numer(), b = rh.denom();
+		int_t a = rh.numer(), b = rh.denom();
 		if(x == 0)	return zero;
 		if(x == 1)	return one;
-		if(x == -1)	return b % 2 ? minus_one : make_num(pow(complex_t{-1.0, 0.0}, rh));
-		int_t out = 1, in = 1, r, n;
-		for(auto f : factorize(x)) {
-			n = div(f.second, b, r);
-			out *= pwr(f.first, n * abs(a));
-			in  *= pwr(f.first, r * abs(a));
+		if(x == -1)	return b % 2 ? (a % 2 ? minus_one : one) : b == 2 ? pow(gaussian{{}, detail::exact(1)}, a) : make_num(pow(complex_t{-1.0, 0.0}, rh));
+		if(b == 0)	return a < 0 ? zero : inf;
+		if(x < 0)	return pow(-1, rh) * (x == std::numeric_limits<int_t>::min() ? pow(-bigint{x}, rh) : pow(-x, rh));
+		uint32_t n = (uint32_t)x, root;
+		if(detail::is_power(n, b, root))	return pow((int_t)root, a);
+		auto factors = detail::factorize(n);
+		long long e = abs(a), g = b;
+		for(auto& f : factors)	g = gcd(g, f.second * e % b);
+		expr out = one, in = one;
+		for(auto& f : factors) {
+			long long k = f.second * e;
+			if(k >= b)		out = out * pow((int_t)f.first, (int_t)(k / b));
+			if(k % b)		in = in * pow((int_t)f.first, (int_t)(k % b / g));
 		}
-		if(in == 1)	return a < 0 ? numeric_t{rational_t{1, out}} : numeric_t{out};
-		powerize(in, e); 
-		normalize(e, b); in = pwr(in, e);
-		return make_prod(out, power{in, make_num(sgn(a), b)});
+		if(a < 0)	out = one / out;
+		return in == one ? out : make_prod(out, power{in, make_num(sgn(a), (int_t)(b / g))});
 	}
 	real_t pow(rational_t lh, real_t rh) { return std::pow(lh.value(), rh); }
 	real_t pow(real_t lh, rational_t rh) { return std::pow(lh, rh.value()); }
 	complex_t pow(rational_t lh, complex_t rh) { return std::pow(lh.value(), rh); }
 	complex_t pow(complex_t lh, rational_t rh) { return std::pow(lh, rh.value()); }
 	expr pow(rational_t lh, rational_t rh) { return (expr{lh.numer()} ^ rh) / (expr{lh.denom()} ^ rh); }
+	expr pow(const bigint& lh, int_t rh) {
+		if(rh >= 0)	return make_num(lh.pow(rh));
+		return make_num(bigrat::reduced(bigint{1}, lh.pow(0u - (unsigned)rh)));
+	}
+	expr pow(int_t lh, const bigint& rh) {
+		if(lh == 0 || lh == 1)	return rh.negative() && lh == 0 ? inf : make_num(lh);
+		if(lh == -1)			return !rh.is_zero() && rh.limbs()[0] % 2 ? minus_one : one;
+		return make_num(std::pow((real_t)lh, (real_t)rh));
+	}
+	expr pow(const bigrat& lh, int_t rh) {				// powers of coprime numbers are coprime
+		unsigned e = rh < 0 ? 0u - (unsigned)rh : (unsigned)rh;
+		if(rh < 0)	return make_num(bigrat::reduced(lh.denom().pow(e), lh.numer().pow(e)));
+		return make_num(bigrat::reduced(lh.numer().pow(e), lh.denom().pow(e)));
+	}
+	// other powers with big operands are irrational or too large for an exact result
+	real_t pow(const bigint& lh, const bigint& rh) { return std::pow(detail::inexact(lh), detail::inexact(rh)); }
+	expr pow(const bigint& lh, rational_t rh) {					// exact only for perfect powers
+		bigint root;
+		if(lh.negative() && rh.denom() % 2)	return pow(-1, rh) * pow(-lh, rh);
+		if(!lh.negative() && detail::is_power(lh, rh.denom(), root))	return make_num(root) ^ make_num(rh.numer());
+		return make_num(std::pow(detail::inexact(lh), detail::inexact(rh)));
+	}
+	real_t pow(rational_t lh, const bigint& rh) { return std::pow(detail::inexact(lh), detail::inexact(rh)); }
+	real_t pow(const bigint& lh, real_t rh) { return std::pow(detail::inexact(lh), rh); }
+	real_t pow(real_t lh, const bigint& rh) { return std::pow(lh, detail::inexact(rh)); }
+	complex_t pow(const bigint& lh, complex_t rh) { return std::pow(detail::inexact(lh), rh); }
+	complex_t pow(complex_t lh, const bigint& rh) { return std::pow(lh, detail::inexact(rh)); }
+	real_t pow(int_t lh, const bigrat& rh) { return std::pow(detail::inexact(lh), detail::inexact(rh)); }
+	real_t pow(const bigrat& lh, rational_t rh) { return std::pow(detail::inexact(lh), detail::inexact(rh)); }
+	real_t pow(rational_t lh, const bigrat& rh) { return std::pow(detail::inexact(lh), detail::inexact(rh)); }
+	real_t pow(const bigrat& lh, real_t rh) { return std::pow(detail::inexact(lh), rh); }
+	real_t pow(real_t lh, const bigrat& rh) { return std::pow(lh, detail::inexact(rh)); }
+	complex_t pow(const bigrat& lh, complex_t rh) { return std::pow(detail::inexact(lh), rh); }
+	complex_t pow(complex_t lh, const bigrat& rh) { return std::pow(lh, detail::inexact(rh)); }
+	real_t pow(const bigrat& lh, const bigint& rh) { return std::pow(detail::inexact(lh), detail::inexact(rh)); }
+	real_t pow(const bigint& lh, const bigrat& rh) { return std::pow(detail::inexact(lh), detail::inexact(rh)); }
+	real_t pow(const bigrat& lh, const bigrat& rh) { return std::pow(detail::inexact(lh), detail::inexact(rh)); }
+	expr pow(const gaussian& lh, int_t rh) {					// lh ≠ 0, zero is never a gaussian
+		auto r = pow(lh, rh < 0 ? 0u - (unsigned)rh : (unsigned)rh);
+		return make_num(rh < 0 ? inverse(r) : r);
+	}
+	// other powers of gaussian rationals are generally irrational
+	template<class T, class U> detail::if_gaussian<T, U> pow(const T& lh, const U& rh) { return make_num(std::pow(detail::inexact(lh), detail::inexact(rh))); }
+	// powers of multiprecision numbers are computed in max_digits, negative bases with fractional exponents are complex
+	inline expr mp_pow(const mpcomplex_t& lh, const mpcomplex_t& rh, unsigned digits) { return detail::make_mp(pow(lh, rh), digits); }
+	inline expr mp_pow(const mpreal_t& lh, const mpreal_t& rh, unsigned digits) {
+		if(lh < 0 && rh != trunc(rh))	return mp_pow(mpcomplex_t{lh}, mpcomplex_t{rh}, digits);
+		return detail::make_mp(pow(lh, rh), digits);
+	}
+	inline expr mp_pow(const mpreal_t& lh, const mpcomplex_t& rh, unsigned digits) { return mp_pow(mpcomplex_t{lh}, rh, digits); }
+	inline expr mp_pow(const mpcomplex_t& lh, const mpreal_t& rh, unsigned digits) { return mp_pow(lh, mpcomplex_t{rh}, digits); }
+	template<class T, class U> detail::if_multi<T, U> pow(const T& lh, const U& rh) {
+		return mp_pow(detail::multi(lh), detail::multi(rh), detail::digits_of(lh, rh));
+	}
+	// integer powers of balls are exact products, other ones are exp(y∙ln(x)) for positive x.
+	// Balls that may be zero or negative with fractional exponents have no real enclosure, they give balls
+	// with infinite radius (and no midpoint if the whole ball is negative), so the loss of bounds is visible.
+	inline expr ball_pow(const ball& x, const ball& y) {
+		if(y.rad() == 0 && y.mid() == trunc(y.mid()) && abs(y.mid()) <= std::numeric_limits<int_t>::max())	return make_num(pow(x, y.mid().convert_to<int_t>()));
+		if(x.mid() > x.rad())	return make_num(exp(y * log(x)));
+		if(x.mid() == 0 && x.rad() == 0 && y.mid() > y.rad())	return make_num(ball{0, 0, x.digits()});
+		auto digits = std::min(x.digits(), y.digits());
+		return make_num(ball::undefined(x.mid() + x.rad() < 0 ? std::numeric_limits<mpreal_t>::quiet_NaN() : pow(std::max(x.mid(), mpreal_t{0}), y.mid()), digits));
+	}
+	template<class T, class U> detail::if_ball<T, U> pow(const T& lh, const U& rh) {
+		auto digits = detail::digits_of(lh, rh);
+		return ball_pow(detail::enclose(lh, digits), detail::enclose(rh, digits));
+	}
 }
@@ -38,7 +38,7 @@ void OpDiv(expr& op1, expr& op2, expr& result) {
 	if(op1 == one)	result = power{op2, -1}; else OpMul(op1, expr{power{op2, -1}}, result);
 }
 void OpPow(expr& op1, expr& op2, expr& result) { result = power{op1, op2}; }
-void OpApp(expr& op1, expr& op2, expr& result) { result = op2; }
+void OpApp(expr& op1, expr& op2, expr& result) { result = approx(op2); }
 
 void OpSubst(expr& op1, expr& op2, expr& result) { result = make_subst(op1, op2); }
 void OpAssign(expr& op1, expr& op2, expr& result) { result = make_assign(op1, op2); }
@@ -57,25 +57,25 @@ Context::Context(const Context *base) : _locals(1)
 	if(_globals.empty())	{
 		// Constants
 		typedef vars_t::value_type pair;
-		_globals.insert(pair("empty",	expr()));
+		_globals.insert(pair(key("empty"),	expr()));
 
 		// Math
 		symbol x{"x"}, f{"f"}, a{"a"}, b{"b"};
-		_globals.insert(pair("inf",		inf));
-		_globals.insert(pair("pi",		pi));
-		_globals.insert(pair("e",		e));
-		_globals.insert(pair("i",		numeric{complex_t{0.0, 1.0}}));
-		_globals.insert(pair("ln",		ln(x)));
-		_globals.insert(pair("sin",		sin(x)));
-		_globals.insert(pair("cos",		cos(x)));
-		_globals.insert(pair("tg",		tg(x)));
-		_globals.insert(pair("arcsin",	arcsin(x)));
-		_globals.insert(pair("arccos",	arccos(x)));
-		_globals.insert(pair("arctg",	arctg(x)));
-		_globals.insert(pair("dif",		make_dif(f, x)));
-		_globals.insert(pair("int",		make_intd(f, x, a, b)));
-		_globals.insert(pair("sqrt",	fn("sqrt", {x}, x^half)));
-		_globals.insert(pair("match",	make_match(a, b)));
+		_globals.insert(pair(key("inf"),		inf));
+		_globals.insert(pair(key("pi"),		pi));
+		_globals.insert(pair(key("e"),		e));
+		_globals.insert(pair(key("i"),		numeric{gaussian{{}, detail::exact(1)}}));
+		_globals.insert(pair(key("ln"),		ln(x)));
+		_globals.insert(pair(key("sin"),		sin(x)));
+		_globals.insert(pair(key("cos"),		cos(x)));
+		_globals.insert(pair(key("tg"),		tg(x)));
+		_globals.insert(pair(key("arcsin"),	arcsin(x)));
+		_globals.insert(pair(key("arccos"),	arccos(x)));
+		_globals.insert(pair(key("arctg"),	arctg(x)));
+		_globals.insert(pair(key("dif"),		make_dif(f, x)));
+		_globals.insert(pair(key("int"),		make_intd(f, x, a, b)));
+		_globals.insert(pair(key("sqrt"),	fn("sqrt", {x}, x^half)));
+		_globals.insert(pair(key("match"),	make_match(a, b)));
 	}
 }
 
@@ -84,17 +84,17 @@ expr& Context::Get(const string& name, bool local)
 	if(!local)	{
 		for(int i = (int)_locals.size() - 1; i >= -1; i--)	{
 			vars_t& plane = i<0?_globals:_locals[i];
-			vars_t::iterator p = plane.find(name);
+			vars_t::iterator p = plane.find(key(name));
 			if(p != plane.end()) return	p->second;
 		}
 	}
-	return _locals.back()[name] = symbol{name.c_str()};
+	return _locals.back()[key(name)] = symbol{name};
 }
 
 bool Context::Get(const string& name, expr& result) const
 {
 	for(std::vector<vars_t>::const_reverse_iterator ri = _locals.rbegin(); ri != _locals.rend(); ri++)	{
-		vars_t::const_iterator p = ri->find(name);
+		vars_t::const_iterator p = ri->find(key(name));
 		if(p != ri->end())	return result = p->second, true;
 	}
 	return false;
@@ -116,12 +116,41 @@ NScript::OpInfo NScript::_operators[Term][10] = {
 expr NScript::eval(string script)
 {
 	expr result = empty;
-	try	{
-		_parser.Init(script);
-		Parse(Statement, result);
-		if(_parser.GetToken() != Parser::end)	throw error_t::syntax;
-	} catch(error_t e) {
-		result = error{e};
+	{
+		eval_arena arena;
+		eval_budget budget(_limits);
+		approx_precision precision(_digits);
+		try	{
+			_parser.Init(script);
+			Parse(Statement, result);
+			if(_parser.GetToken() != Parser::end)	throw error_t::syntax;
+		} catch(error_t e) {
+			result = error{e};
+		}
+		_allocated = arena.bytes();
+	}
+	return promote(result);
+}
+
+expr NScript::simplify(const expr& e, bool approximate)
+{
+	expr result;
+	{
+		eval_arena arena;
+		eval_budget budget(_limits);
+		approx_precision precision(_digits);
+		try	{
+			result = *e;
+			if(approximate)	result = ~result;
+		} catch(error_t err) {
+			result = error{err};
+		}
+		_allocated += arena.bytes();
+	}
+	result = promote(result);
+	if(is<symbol>(result) && as<symbol>(result).value() != empty) {	// assignments are kept in the context of the script
+		expr val = as<symbol>(result).value();
+		_context.Set(as<symbol>(result).name(), is<func>(val) ? val : result);
 	}
 	return result;
 }
@@ -261,24 +290,26 @@ void Parser::ReadNumber(char c)
 	int base = 10, m = c - '0';
 	int e1 = 0, e2 = 0, esign = 1;
 	bool overflow = false;
+	bigint big;													// integer part beyond int
+	auto digit = [&](int v) {
+		if(!big.is_zero())						big = big * bigint{base} + bigint{v};
+		else if(m > (std::numeric_limits<int>::max() - v) / base)	big = bigint{m} * bigint{base} + bigint{v};
+		else									m = m * base + v;
+	};
 
 	while(c = Read())	{	
 		if(isdigit(c))	{
 			char v = c - '0';
-			if(stage == nsint) {
-				if(m > (LONG_MAX - v) / base)	throw error_t::syntax;
-				m = m * base + v;
-			}
+			if(stage == nsint)			digit(v);
 			else if(stage == nsexp)		stage = nspwr;
-			else if(stage == nsdot && !overflow)	{
+			else if(stage == nsdot && !overflow && big.is_zero())	{
 				if(m > (LONG_MAX - v) / base)	overflow = true;
 				else							m = m * base + v, e1--;
 			}
 			if(stage == nspwr)		e2 = e2 * 10  + v;
 		}	else if(isxdigit(c))		{
 			char v = 10 + (toupper(c) - 'A');
-			if(m > (LONG_MAX - v) / base)	throw error_t::syntax;
-			m = m * base + v;
+			digit(v);
 		}	else if(c == '.')		{
 			if(stage > nsint)	break;
 			stage = nsdot;
@@ -293,8 +324,8 @@ void Parser::ReadNumber(char c)
 	Back();
 	if(stage == nsexp)	throw error_t::syntax;
 	if(stage == nsint)	{
-		_value = m;												// integers
-	}	else				_value = m * pow(10., e1+esign*e2);	// floating-point
+		_value = big.is_zero() ? expr{m} : make_num(big);		// integers
+	}	else				_value = (big.is_zero() ? m : (real_t)big) * pow(10., e1+esign*e2);	// floating-point
 	_token = Parser::value;
 }
 
@@ -23,9 +23,10 @@ public:
 	void Pop()		{_locals.pop_back();}
 	expr& Get(const string& name, bool local = false);
 	bool Get(const string& name, expr& result) const;
-	void Set(const string& name, const expr& value)		{_locals.front()[name] = value;}
+	void Set(const string& name, const expr& value)		{_locals.front()[key(name)] = value;}
 private:
-	struct vars_t : public std::map<string, expr> {};
+	static uint32_t key(const string& name)	{return detail::symbol_table::get().id(name);}
+	struct vars_t : public std::map<uint32_t, expr> {};
 	static vars_t		_globals;
 	std::vector<vars_t>	_locals;
 };
@@ -75,7 +76,11 @@ public:
 	NScript(const Context *pcontext = NULL) : _context(pcontext)	{}
 	~NScript(void)						{};
 	expr eval(string script);
+	expr simplify(const expr& e, bool approximate = false);	// simplifies (and approximates) the result of eval in its own arena, keeps assignments
 	void set(string name, expr value) { _context.Set(name, value); }
+	void limit(const eval_limits& limits) { _limits = limits; }	// budget of every eval and simplify, exceeding it gives error_t::limit
+	void precision(unsigned digits) { _digits = digits; }	// decimal digits of approx in every eval, 0 approximates with double
+	size_t allocated() const { return _allocated; }	// bytes allocated by the last eval and the simplification of its result
 
 protected:
 	enum Precedence	{Statement, Approx, Assignment, Subst, Addition,Multiplication,Power,Unary,Functional,Primary,Term};
@@ -84,6 +89,9 @@ protected:
 
 	Parser				_parser;
 	Context				_context;
+	size_t				_allocated = 0;
+	eval_limits			_limits;
+	unsigned			_digits = 0;
 
 	typedef void OpFunc(expr& op1, expr& op2, expr& result);
 	struct OpInfo { Parser::Token token; OpFunc* op; };
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "common.h"
+#include "numeric.h"
+
+namespace cas {
+
+// Sparse distributed polynomial: terms with nonzero numeric coefficients in descending order of monomials.
+// A monomial packs the exponents of all variables into 64 bits, the first variable in the highest field, so
+// monomials are compared as integers (lexicographic order) and multiplied by adding them. The top bit of each
+// field is a guard that catches exponent overflows of products.
+class polynomial
+{
+public:
+	typedef uint64_t monomial_t;
+	typedef std::pair<monomial_t, numeric_t> term_t;
+
+private:
+	list_t				_vars;
+	unsigned			_bits;			// width of an exponent field including the guard bit, at most 32 so exponents fit int_t
+	monomial_t			_guards;		// guard bits of all fields
+	std::vector<term_t>	_terms;
+
+	static bool is_zero(const numeric_t& c) { return c.type() == typeid(int_t) && boost::get<int_t>(c) == 0; }
+	static numeric_t add(const numeric_t& lh, const numeric_t& rh) { return as<numeric>(lh + rh).value(); }
+	static numeric_t mul(const numeric_t& lh, const numeric_t& rh) { return as<numeric>(lh * rh).value(); }
+	unsigned shift(size_t var) const { return (unsigned)(_vars.size() - 1 - var) * _bits; }
+
+	// Sorts the terms and adds up the ones with equal monomials
+	void normalize() {
+		std::sort(_terms.begin(), _terms.end(), [](const term_t& l, const term_t& r) { return l.first > r.first; });
+		auto out = _terms.begin();
+		for(auto it = _terms.begin(); it != _terms.end(); ) {
+			term_t t = *it;
+			while(++it != _terms.end() && it->first == t.first)	t.second = add(t.second, it->second);
+			if(!is_zero(t.second))	*out++ = std::move(t);
+		}
+		_terms.erase(out, _terms.end());
+	}
+
+	// Terms of (Σ cᵢmᵢ)ⁿ from the i-th one on, for all kᵢ+…+kₘ = rest: C(rest, kᵢ)∙cᵢ^kᵢ∙mᵢ^kᵢ times the following ones
+	void multinomial(size_t i, unsigned rest, monomial_t m, const numeric_t& c, const std::vector<std::vector<numeric_t>>& binomials,
+		const std::vector<std::vector<numeric_t>>& powers, std::vector<term_t>& out) const {
+		auto& t = _terms[i];
+		if(i + 1 == _terms.size()) {
+			out.emplace_back(m + t.first * rest, mul(c, powers[i][rest]));
+			detail::check_budget();
+			return;
+		}
+		for(unsigned k = 0; k <= rest; k++)	multinomial(i + 1, rest - k, m + t.first * k, mul(c, mul(binomials[rest][k], powers[i][k])), binomials, powers, out);
+	}
+
+	// Variable and exponent of a factor: xⁿ with a whole n > 0, other factors are variables with exponent 1
+	static std::pair<expr, int_t> split_factor(const expr& f) {
+		if(is<power>(f) && is<numeric, int_t>(as<power>(f).y()) && as<numeric, int_t>(as<power>(f).y()) > 0) {
+			auto& x = as<power>(f).x();
+			if(!is<numeric>(x) && !is<sum>(x) && !is<product>(x))	return {x, as<numeric, int_t>(as<power>(f).y())};
+		}
+		return {f, 1};
+	}
+	bool add_term(const expr& t) {
+		term_t term{0, numeric_t{1}};
+		list_t factors = is<product>(t) ? list_t(as<product>(t).begin(), as<product>(t).end()) : list_t{t};
+		for(auto& f : factors) {
+			if(is<numeric>(f))	{ term.second = mul(term.second, as<numeric>(f).value()); continue; }
+			auto xn = split_factor(f);
+			auto it = std::find(_vars.begin(), _vars.end(), xn.first);
+			if(it == _vars.end() || (unsigned long long)xn.second > max_exponent())	return false;
+			term.first = mul_monomials(term.first, (monomial_t)xn.second << shift(it - _vars.begin()));
+		}
+		_terms.push_back(std::move(term));
+		return true;
+	}
+
+public:
+	static constexpr size_t max_vars = 64;
+
+	explicit polynomial(list_t vars) : _vars(std::move(vars)), _bits(_vars.size() < 2 ? 32 : 64 / (unsigned)_vars.size()), _guards(0) {
+		if(_vars.size() > max_vars)	throw error_t::limit;
+		for(size_t i = 0; i < _vars.size(); i++)	_guards |= 1ull << (shift(i) + _bits - 1);
+	}
+	polynomial(list_t vars, std::vector<term_t> terms) : polynomial(std::move(vars)) { _terms = std::move(terms); normalize(); }
+
+	// Variables of a polynomial expression in the order of appearance: symbols and other subexpressions that are
+	// not numbers, sums, products or their whole positive powers. They are appended to vars.
+	static list_t variables(const expr& e, list_t vars = {}) {
+		list_t terms = is<sum>(e) ? list_t(as<sum>(e).begin(), as<sum>(e).end()) : list_t{e};
+		for(auto& t : terms) {
+			list_t factors = is<product>(t) ? list_t(as<product>(t).begin(), as<product>(t).end()) : list_t{t};
+			for(auto& f : factors) {
+				if(is<numeric>(f))	continue;
+				auto x = split_factor(f).first;
+				if(std::find(vars.begin(), vars.end(), x) == vars.end())	vars.push_back(x);
+			}
+		}
+		return vars;
+	}
+	// Polynomial of e in the variables vars, false if e has other variables or too large exponents
+	static bool from_expr(const expr& e, const list_t& vars, polynomial& p) {
+		p = polynomial(vars);
+		if(is<sum>(e)) {
+			for(auto& t : as<sum>(e))	if(!p.add_term(t))	return false;
+		} else if(!p.add_term(e))	return false;
+		p.normalize();
+		return true;
+	}
+	expr to_expr() const {
+		list_t terms;
+		for(auto& t : _terms) {
+			list_t factors{numeric{t.second}};
+			for(size_t i = 0; i < _vars.size(); i++)	if(auto n = exponent(t.first, i))	factors.push_back(_vars[i] ^ make_num((int_t)n));
+			terms.push_back(make_prod(std::move(factors)));
+		}
+		return make_sum(std::move(terms));
+	}
+
+	const list_t& vars() const { return _vars; }
+	const std::vector<term_t>& terms() const { return _terms; }
+	bool empty() const { return _terms.empty(); }
+	monomial_t max_exponent() const { return (1ull << (_bits - 1)) - 1; }
+	unsigned exponent(monomial_t m, size_t var) const { return (unsigned)(m >> shift(var) & (max_exponent() << 1 | 1)); }
+	// product of monomials, throws error_t::limit if an exponent overflows its field
+	monomial_t mul_monomials(monomial_t lh, monomial_t rh) const {
+		monomial_t m = lh + rh;
+		if(m & _guards)	throw error_t::limit;
+		return m;
+	}
+
+	unsigned degree(size_t var) const {
+		unsigned d = 0;
+		for(auto& t : _terms)	d = std::max(d, exponent(t.first, var));
+		return d;
+	}
+	// exponents of the product and the power fit their fields
+	bool fits_product(const polynomial& rh) const {
+		for(size_t i = 0; i < _vars.size(); i++)	if(degree(i) + rh.degree(i) > max_exponent())	return false;
+		return true;
+	}
+	bool fits_power(unsigned n) const {
+		for(size_t i = 0; i < _vars.size(); i++)	if((unsigned long long)degree(i) * n > max_exponent())	return false;
+		return true;
+	}
+
+	// Operands have the same variables
+	friend polynomial operator + (const polynomial& lh, const polynomial& rh) {
+		std::vector<term_t> terms;
+		terms.reserve(lh._terms.size() + rh._terms.size());
+		std::merge(lh._terms.begin(), lh._terms.end(), rh._terms.begin(), rh._terms.end(), std::back_inserter(terms), [](const term_t& l, const term_t& r) { return l.first > r.first; });
+		return {lh._vars, std::move(terms)};
+	}
+	// Johnson's heap multiplication: the heap holds the next product of each term of the shorter operand, so the
+	// products come out in descending order and like terms are added as soon as they meet, without sorting
+	friend polynomial operator * (const polynomial& lh, const polynomial& rh) {
+		auto& a = lh._terms.size() <= rh._terms.size() ? lh._terms : rh._terms;
+		auto& b = lh._terms.size() <= rh._terms.size() ? rh._terms : lh._terms;
+		struct entry { monomial_t m; size_t i, j; };
+		auto less = [](const entry& l, const entry& r) { return l.m < r.m; };
+		std::vector<entry> heap;
+		for(size_t i = 0; i < a.size() && !b.empty(); i++)	heap.push_back({lh.mul_monomials(a[i].first, b[0].first), i, 0});
+		std::make_heap(heap.begin(), heap.end(), less);
+		polynomial r{lh._vars};
+		auto& terms = r._terms;
+		while(!heap.empty()) {
+			std::pop_heap(heap.begin(), heap.end(), less);
+			auto& e = heap.back();
+			auto c = mul(a[e.i].second, b[e.j].second);
+			if(!terms.empty() && terms.back().first == e.m)	terms.back().second = add(terms.back().second, c);
+			else {
+				if(!terms.empty() && is_zero(terms.back().second))	terms.pop_back();
+				terms.emplace_back(e.m, std::move(c));
+			}
+			if(++e.j < b.size())	e.m = lh.mul_monomials(a[e.i].first, b[e.j].first), std::push_heap(heap.begin(), heap.end(), less);
+			else					heap.pop_back();
+			detail::check_budget();
+		}
+		if(!terms.empty() && is_zero(terms.back().second))	terms.pop_back();
+		return r;
+	}
+	// Powers of polynomials whose terms give mostly distinct products, like sums of different variables, are
+	// expanded by the multinomial theorem, each term of the result is computed once. Other ones, where many
+	// products collapse (dense univariate ones), or whose table of binomials would outgrow the result, are
+	// computed by squaring.
+	friend polynomial pow(const polynomial& x, unsigned n) {
+		if(x._terms.empty())	return n ? x : polynomial{x._vars, {term_t{0, numeric_t{1}}}};
+		if(!x.fits_power(n))	throw error_t::limit;
+		double products = 1, dense = 1;									// C(n+k-1, k-1) and the size of a dense result
+		for(size_t k = 1; k < x._terms.size(); k++)	products = products * (n + k) / k;
+		for(size_t i = 0; i < x._vars.size(); i++)	dense *= (double)x.degree(i) * n + 1;
+		if(products > dense || products < (double)n * (n + 1) / 2) {
+			polynomial r{x._vars, {term_t{0, numeric_t{1}}}}, p = x;
+			for(; n; n /= 2, p = n ? p * p : p)	if(n % 2)	r = r * p;
+			return r;
+		}
+		std::vector<std::vector<numeric_t>> binomials(n + 1), powers(x._terms.size());
+		for(unsigned m = 0; m <= n; m++) {
+			binomials[m].assign(m + 1, numeric_t{1});
+			for(unsigned k = 1; k < m; k++)	binomials[m][k] = add(binomials[m - 1][k - 1], binomials[m - 1][k]);
+		}
+		for(size_t i = 0; i < x._terms.size(); i++) {
+			powers[i].assign(1, numeric_t{1});
+			for(unsigned k = 1; k <= n; k++)	powers[i].push_back(mul(powers[i].back(), x._terms[i].second));
+		}
+		std::vector<term_t> terms;
+		x.multinomial(0, n, 0, numeric_t{1}, binomials, powers, terms);
+		return {x._vars, std::move(terms)};
+	}
+};
+
+}
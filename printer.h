@@ -64,9 +64,69 @@ inline ostream& operator << (ostream& os, const rational_t& r) {
 	}
 }
 
+inline ostream& operator << (ostream& os, const bigrat& r) {
+	if(is_mml(os)) {
+		auto n = r.numer().negative() ? -r.numer() : r.numer();
+		if(get_part(os) == part_t::num) {
+			if(n != bigint{1})		os << "<mn>" << n << "</mn>";
+		} else if(get_part(os) == part_t::den) {
+			os << "<mn>" << r.denom() << "</mn>";
+		} else
+			os << (r.numer().negative() ? "<mo>&minus;</mo>" : "") << "<mfrac" << (is_bevel(os) ? " bevelled='true'" : "") << "><mn>" << n << "</mn><mn>" << r.denom() << "</mn></mfrac>";
+		return os;
+	} else
+		return os << r.str();
+}
+
+inline ostream& operator << (ostream& os, const mpreal& x) { return os << x.str(); }
+
+inline ostream& operator << (ostream& os, const ball& x) {
+	if(!is_mml(os))		return os << x.str();
+	if(is_den(os))		return os;
+	os << "<mrow><mn>" << x.mid().str(x.digits()) << "</mn>";
+	if(x.rad() != 0)	os << "<mo>&PlusMinus;</mo><mn>" << x.rad().str(2) << "</mn>";
+	return os << "</mrow>";
+}
+
+inline ostream& operator << (ostream& os, const mpcomplex& c) {
+	mpreal re{c.value().real(), c.digits()}, im{abs(c.value().imag()), c.digits()};
+	bool neg = c.value().imag() < 0;
+	if(is_mml(os)) {
+		if(is_den(os))	return os;
+		os << "<mrow>";
+		if(re.value() != 0)	os << "<mn>" << re << "</mn><mo>" << (neg ? "&minus;" : "&plus;") << "</mo>";
+		else if(neg)		os << "<mo>&minus;</mo>";
+		if(im.value() != 1)	os << "<mn>" << im << "</mn>";
+		return os << "<mi>&ImaginaryI;</mi></mrow>";
+	} else {
+		if(re.value() != 0)	os << re << (neg ? '-' : '+');
+		else if(neg)		os << '-';
+		if(im.value() != 1)	os << im;
+		return os << 'i';
+	}
+}
+
+inline ostream& operator << (ostream& os, const gaussian& c) {
+	bool neg = c.im().numer().negative();
+	expr re = make_num(c.re()), im = make_num(neg ? -c.im() : c.im());
+	if(is_mml(os)) {
+		if(is_den(os))	return os;
+		os << "<mrow>";
+		if(re != zero)	os << re << "<mo>" << (neg ? "&minus;" : "&plus;") << "</mo>";
+		else if(neg)	os << "<mo>&minus;</mo>";
+		if(im != one)	os << im;
+		return os << "<mi>&ImaginaryI;</mi></mrow>";
+	} else {
+		if(re != zero)	os << re << (neg ? '-' : '+');
+		else if(neg)	os << '-';
+		if(im != one)	os << im;
+		return os << 'i';
+	}
+}
+
 inline ostream& operator << (ostream& os, numeric n) { 
 	if(is_mml(os)) {
-		if(is<numeric, int_t>(n) || is<numeric, real_t>(n)) {
+		if(is<numeric, int_t>(n) || is<numeric, real_t>(n) || is<numeric, bigint>(n) || is<numeric, mpreal>(n)) {
 			if(is_den(os))	return os;
 			return os << "<mn>" << n.value() << "</mn>";
 		} else
@@ -79,8 +139,8 @@ inline ostream& operator << (ostream& os, numeric n) {
 inline ostream& operator << (ostream& os, symbol s) { 
 	if(is_mml(os)) {
 		if(is_den(os))			return os;
-		if(s.name() == "#p")	return os << "<mi>&pi;</mi>";
-		if(s.name() == "#e")	return os << "<mi>e</mi>";
+		if(s.sid() == detail::symbol_table::const_pi)	return os << "<mi>&pi;</mi>";
+		if(s.sid() == detail::symbol_table::const_e)	return os << "<mi>e</mi>";
 		return os << "<mi>" << s.name() << "</mi>";
 	}
 	else			return os << s.name();
@@ -137,8 +197,7 @@ inline ostream& join_streams(ostream& os, std::ostringstream& osl, std::ostrings
 static void get_multiplicands(list_t& multiplicands, const expr& x, part_t part)
 {
 	if(is<product>(x)) {
-		get_multiplicands(multiplicands, as<product>(x).left(), part);
-		get_multiplicands(multiplicands, as<product>(x).right(), part);
+		for(auto& m : as<product>(x))	get_multiplicands(multiplicands, m, part);
 	} else if(is<power>(x)) {
 		if(as<power>(x).y() == minus_one && part == part_t::den)	multiplicands.push_back(as<power>(x).x());
 		else if(as<power>(x).y() < zero && part == part_t::den)		multiplicands.push_back(x);
@@ -209,7 +268,7 @@ static bool is_simple(expr e, expr dx)
 {
 	if(!is<func>(e))	return false;
 	func& f = as<func>(e);
-	if(f.args().size() == 1 && df(f.x(), dx) != zero)	return true;
+	if(f.args().size() == 1 && depends_on(f.x(), dx))	return true;
 	return false;
 }
 
@@ -20,8 +20,10 @@
 #include <memory>
 #include <sstream>
 #include <string>
+#include <tuple>
 #include <unordered_set>
 #include <vector>
 
 #include <boost/variant.hpp>
+#include <boost/functional/hash.hpp>
 #include <boost/math/constants/constants.hpp>
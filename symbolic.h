@@ -6,24 +6,44 @@
 #include "common.h"
 #include "numeric.h"
 #include "functions.h"
+#include "poly.h"
 
 namespace cas {
 
 using std::enable_if;
 using std::is_same;
 
-static int_t binomial(int_t n, int_t k) {
-	int_t a = 1, b = 1;
-	for(int_t l = 1; l <= k; l++)	a *= (n - l + 1), b *= l;
-	return a / b;
+static expr binomial(int_t n, int_t k) {
+	bigint c{1};									// C(n,l) = C(n,l-1)∙(n-l+1)/l is always whole
+	for(int_t l = 1; l <= k; l++)	c = c * bigint{n - l + 1}, c.div_small(l);
+	return make_num(std::move(c));
 }
 
 inline expr product::op(const expr& lh, const expr& rh) { return lh * rh; }
 inline expr sum::op(const expr& lh, const expr& rh) { return lh + rh; }
+// Like factors are powers of the same base (xⁿ∙xᵐ), all numbers are like factors
+inline size_t product::key(const expr& e) {
+	if(is<numeric>(e))	return 1;
+	size_t seed = 5;
+	boost::hash_combine(seed, detail::hash_of(is<power>(e) ? as<power>(e).x() : e));
+	return seed;
+}
+// Like terms differ only in numeric coefficients (Ax+Bx), all numbers are like terms
+inline size_t sum::key(const expr& e) {
+	if(is<numeric>(e))	return 1;
+	size_t seed = 6;
+	if(!is<product>(e))	{ boost::hash_combine(seed, detail::hash_of(e)); return seed; }
+	auto& p = as<product>(e);
+	for(auto it = p.begin() + (is<numeric>(p.left()) ? 1 : 0); it != p.end(); ++it)	boost::hash_combine(seed, detail::hash_of(*it));
+	return seed;
+}
+inline expr product::make(list_t items) { return make_prod(std::move(items)); }
+inline expr sum::make(list_t items) { return make_sum(std::move(items)); }
 
 inline expr make_err(error_t err) { return error{err}; }
 
 inline expr make_power(expr x, expr y) {
+	detail::check_budget();
 	if(is<error>(x))	return x;
 	if(is<error>(y))	return y;
 	if(is<numeric>(x) && is<numeric>(y))	return as<numeric>(x).value() ^ as<numeric>(y).value();
@@ -82,6 +102,118 @@ inline expr make_prod(expr left, expr right)
 	return product{left, right};
 }
 
+namespace detail {
+
+// Collects (key, value) pairs with equal keys in the order of their first occurrence. Equal keys are found through
+// a table of their hashes and grouped by ==, the merged elements are sorted once by make_list.
+template<class F> list_t merge_terms(const std::vector<pair<expr, expr>>& terms, F make) {
+	std::unordered_map<size_t, std::vector<size_t>> groups;	// hash of the key ⇒ positions in merged
+	std::vector<pair<expr, expr>> merged;
+	for(auto& t : terms) {
+		auto& group = groups[hash_of(t.first)];
+		auto it = std::find_if(group.begin(), group.end(), [&merged, &t](size_t i) { return merged[i].first == t.first; });
+		if(it == group.end())	group.push_back(merged.size()), merged.push_back(t);
+		else					merged[*it].second = merged[*it].second + t.second;
+	}
+	list_t res;
+	res.reserve(merged.size());
+	for(auto& m : merged)	res.push_back(make(m.first, m.second));
+	return res;
+}
+
+// Side of the sin and cos elements which the pairwise operator cancels with a partner of the same argument, -1 for
+// others: sin²u (0) and cos²u (1) in sums, sin u (0) and cos⁻¹u (1), cos u (2) and sin⁻¹u (3) in products
+inline int trig_side(const expr& e, const sum*) {
+	if(!is<power>(e) || as<power>(e).y() != two)	return -1;
+	auto& f = as<power>(e).x();
+	return is_func(f, S_SIN) ? 0 : is_func(f, S_COS) ? 1 : -1;
+}
+inline int trig_side(const expr& e, const product*) {
+	if(is_func(e, S_SIN))	return 0;
+	if(is_func(e, S_COS))	return 2;
+	if(!is<power>(e) || as<power>(e).y() != minus_one)	return -1;
+	auto& f = as<power>(e).x();
+	return is_func(f, S_COS) ? 1 : is_func(f, S_SIN) ? 3 : -1;
+}
+inline const expr& trig_arg(const expr& e) { return as<func>(is<power>(e) ? as<power>(e).x() : e).x(); }
+
+// Builds the list from merged elements sorted once in the canonical order. Numbers are added up, sin and cos
+// partners of the same argument are combined by the pairwise operator, and so are the elements the list
+// cannot hold as they are (nested lists), all other elements go to the list directly.
+template<class T> expr make_list(list_t items) {
+	typename T::key_comp comp;
+	auto op = [](const expr& r, const expr& e) { return T::op(r, e); };
+	const T *tag = nullptr;
+	expr num = T::unit();
+	list_t list, rest;
+	std::unordered_map<size_t, std::vector<size_t>> trig;	// hash of the argument ⇒ positions of unpaired sin and cos in list
+	for(auto& e : items) {
+		if(is<error>(e))	return e;
+		if(is<numeric>(e))	{ num = op(num, e); continue; }
+		if(is<T>(e))		{ rest.push_back(e); continue; }
+		auto side = trig_side(e, tag);
+		if(side >= 0) {
+			auto& group = trig[hash_of(trig_arg(e))];
+			auto it = std::find_if(group.begin(), group.end(), [&list, &e, side, tag](size_t i) { return trig_side(list[i], tag) == (side ^ 1) && trig_arg(list[i]) == trig_arg(e); });
+			if(it != group.end()) {
+				auto c = side & 1 ? op(list[*it], e) : op(e, list[*it]);
+				if(is<numeric>(c))	num = op(num, c);
+				else				rest.push_back(c);
+				list[*it] = T::unit();
+				group.erase(it);
+				continue;
+			}
+			group.push_back(list.size());
+		}
+		list.push_back(e);
+	}
+	if(is<error>(num))	return num;
+	list.erase(std::remove(list.begin(), list.end(), T::unit()), list.end());
+	if(num != T::unit())	list.push_back(num);
+	std::sort(list.begin(), list.end(), comp);
+	expr res = list.size() < 3 ? std::accumulate(list.begin(), list.end(), T::unit(), op) : T{std::move(list)};
+	return std::accumulate(rest.begin(), rest.end(), res, op);
+}
+
+}
+
+// Σ Aᵢ∙x ⇒ (Σ Aᵢ)∙x
+inline expr make_sum(list_t terms) {
+	detail::check_budget();
+	expr num = zero;
+	std::vector<pair<expr, expr>> coeffs;
+	for(size_t i = 0; i < terms.size(); i++) {
+		expr t = terms[i];
+		if(is<error>(t))			return t;
+		if(is<sum>(t))				terms.insert(terms.end(), as<sum>(t).begin(), as<sum>(t).end());
+		else if(is<numeric>(t))		num = num + t;
+		else if(is<product>(t) && is<numeric>(as<product>(t).left()))	coeffs.emplace_back(as<product>(t).right(), as<product>(t).left());
+		else						coeffs.emplace_back(t, one);
+	}
+	auto res = detail::merge_terms(coeffs, [](const expr& x, const expr& a) { return a * x; });
+	res.push_back(num);
+	return detail::make_list<sum>(std::move(res));
+}
+
+// Π xⁿⁱ ⇒ x^(Σ nᵢ)
+inline expr make_prod(list_t factors) {
+	detail::check_budget();
+	expr num = one;
+	std::vector<pair<expr, expr>> exps;
+	for(size_t i = 0; i < factors.size(); i++) {
+		expr f = factors[i];
+		if(is<error>(f))			return f;
+		if(is<product>(f))			factors.insert(factors.end(), as<product>(f).begin(), as<product>(f).end());
+		else if(is<numeric>(f))		num = num * f;
+		else if(is<power>(f))		exps.emplace_back(as<power>(f).x(), as<power>(f).y());
+		else						exps.emplace_back(f, one);
+	}
+	if(num == zero)	return zero;
+	auto res = detail::merge_terms(exps, [](const expr& x, const expr& n) { return x ^ n; });
+	res.push_back(num);
+	return detail::make_list<product>(std::move(res));
+}
+
 inline expr make_xset(std::initializer_list<expr> items)
 {
 	if(items.size() == 1)	return *items.begin();
@@ -108,7 +240,11 @@ template<> struct is_algebraic<xset>		: std::true_type {};
 template<typename T, typename U, typename = std::enable_if_t<is_algebraic<T>::value && is_algebraic<U>::value>> expr operator + (T lh, U rh) { return make_sum(std::move(lh), std::move(rh)); }
 template<typename T, typename = std::enable_if_t<!is_same<T, expr>::value>> expr operator + (T e, sum s) { return s.append(e); }
 template<typename T, typename = std::enable_if_t<!is_same<T, expr>::value>> expr operator + (sum s, T e) { return s.append(e); }
-inline expr operator + (sum s, sum a) { return s.append(a.left()) + a.right(); }
+inline expr operator + (sum s, sum a) {
+	list_t terms(s.begin(), s.end());
+	terms.insert(terms.end(), a.begin(), a.end());
+	return make_sum(std::move(terms));
+}
 inline expr operator + (power lh, power rh) {
 	if(lh.y() == two && rh.y() == two) {			// sin²(x)+cos²(x)=1
 		if(is_func(lh.x(), S_SIN) && is_func(rh.x(), S_COS) && as<func>(lh.x()).x() == as<func>(rh.x()).x())	return one;
@@ -121,10 +257,19 @@ inline expr operator + (power lh, power rh) {
 template<typename T, typename U, typename = std::enable_if_t<is_algebraic<T>::value && is_algebraic<U>::value>> expr operator * (T lh, U rh) { return make_prod(std::move(lh), std::move(rh)); }
 template<typename T, typename = std::enable_if_t<!is_same<T, expr>::value && !is_same<T, sum>::value>> expr operator * (T e, product s) { return s.append(e); }
 template<typename T, typename = std::enable_if_t<!is_same<T, expr>::value && !is_same<T, sum>::value>> expr operator * (product s, T e) { return s.append(e); }
-inline expr operator * (product s, product a) { return s.append(a.left()) * a.right(); }
-template<typename T, typename = std::enable_if_t<!is_same<T, expr>::value>> expr operator * (T e, sum s) { return e * s.left() + e * s.right(); }
-template<typename T, typename = std::enable_if_t<!is_same<T, expr>::value>> expr operator * (sum s, T e) { return s.left() * e + s.right() * e; }
-inline expr operator * (sum lh, sum rh) { return lh.left() * rh.left() + lh.left() * rh.right() + lh.right() * rh.left() + lh.right() * rh.right(); }
+inline expr operator * (product s, product a) { expr r = s; for(auto& e : a) r = r * e; return r; }
+template<typename T, typename = std::enable_if_t<!is_same<T, expr>::value>> expr operator * (T e, sum s) { return s.combine([&e](const expr& x) { return e * x; }); }
+template<typename T, typename = std::enable_if_t<!is_same<T, expr>::value>> expr operator * (sum s, T e) { return s.combine([&e](const expr& x) { return x * e; }); }
+inline expr operator * (sum lh, sum rh) {
+	list_t vars = polynomial::variables(rh, polynomial::variables(lh));
+	if(vars.size() <= polynomial::max_vars) {		// polynomials are multiplied at once, like terms are added in one pass
+		polynomial p{vars}, q{vars};
+		if(polynomial::from_expr(lh, vars, p) && polynomial::from_expr(rh, vars, q) && p.fits_product(q))	return (p * q).to_expr();
+	}
+	list_t res;										// (a+b)(c+d) ⇒ ac+ad+bc+bd
+	for(auto& l : lh)	for(auto& r : rh)	res.push_back(l * r);
+	return make_sum(std::move(res));
+}
 inline expr operator * (func lh, power rh) {
 	if(is_func(lh, S_SIN) && is_func(rh.x(), S_COS) && as<func>(lh).x() == as<func>(rh.x()).x() && rh.y() == minus_one)	return tg(as<func>(lh).x());
 	if(is_func(lh, S_COS) && is_func(rh.x(), S_SIN) && as<func>(lh).x() == as<func>(rh.x()).x() && rh.y() == minus_one)	return 1/tg(as<func>(lh).x());
@@ -134,15 +279,20 @@ inline expr operator * (func lh, power rh) {
 // Power
 template<typename T, typename U, typename = std::enable_if_t<is_algebraic<T>::value>> expr operator ^ (T x, U y) { return make_power(std::move(x), std::move(y)); }
 template<typename T, typename = std::enable_if_t<!is_same<T, expr>::value>> expr operator ^ (power p, T y) { return make_power(p.x(), p.y() * expr{y}); }
-template<typename T, typename = std::enable_if_t<!is_same<T, expr>::value>> expr operator ^ (product p, T y) { return (p.left() ^ y) * (p.right() ^ y); }
+template<typename T, typename = std::enable_if_t<!is_same<T, expr>::value>> expr operator ^ (product p, T y) { return p.combine([&y](const expr& x) { return x ^ y; }); }
 inline expr operator ^ (sum s, numeric num) {
 	if(num.value().type() != typeid(int_t) || num.value() == numeric_t{0} || num.has_sign())	return make_power(s, num);
 	int_t n = boost::get<int_t>(num.value());
-	expr res(0);
+	list_t vars = polynomial::variables(s);
+	if(vars.size() <= polynomial::max_vars && (uint64_t)n <= std::numeric_limits<unsigned>::max()) {	// (a+b+…)ⁿ ⇒ Σ n!/(k₁!k₂!…)∙aᵏ¹∙bᵏ²…
+		polynomial p{vars};
+		if(polynomial::from_expr(s, vars, p) && p.fits_power((unsigned)n))	return pow(p, (unsigned)n).to_expr();
+	}
+	list_t res;
 	for(int_t k = 0; k <= n; k++) {					// (a+b)ⁿ ⇒ Σ C(n,k)∙aⁿ⁻ᵏ∙bᵏ
-		res = res + binomial(n, k) * (s.left() ^ (n - k)) * (s.right() ^ k);
+		res.push_back(binomial(n, k) * (s.left() ^ (n - k)) * (s.right() ^ k));
 	}
-	return res;
+	return make_sum(std::move(res));
 }
 
 inline expr operator + (expr op1, expr op2) { return boost::apply_visitor([](auto x, auto y) {return x + y; }, op1, op2); }